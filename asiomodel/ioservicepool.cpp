@@ -7,11 +7,24 @@
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
+#include "buffer/Numa.h"
 
 using namespace boost;
 
 namespace AsioModel{
 
+	namespace
+	{
+		void run_on_node(boost::shared_ptr<asio::io_service> io_service, std::size_t node, bool bind)
+		{
+			if (bind)
+			{
+				BaseLib::Numa::bindThreadToNode(node);
+			}
+			io_service->run();
+		}
+	}
+
 	/// <summary>
 	/// Initializes a new instance of the <see cref="IoServicePool"/> class.
 	/// </summary>
@@ -20,6 +33,7 @@ namespace AsioModel{
 		: next_io_service_(0)
 		, pool_size_(pool_size)
 		, running_(false)
+		, bind_numa_(false)
 	{
 		// Create a pool of threads to run all of the io_services.
 		if (pool_size_ == 0)
@@ -41,6 +55,7 @@ namespace AsioModel{
 	/// </summary>
 	IoServicePool::IoServicePool()
 		: next_io_service_(0)
+		, bind_numa_(false)
 	{
 
 	}
@@ -51,10 +66,11 @@ namespace AsioModel{
 	void IoServicePool::run()
 	{
 		// Ч󣬲޸poolsize
+		const std::size_t nodes = BaseLib::Numa::nodeCount();
 		for (std::size_t i = 0; i < io_services_.size(); ++i)
 		{
 			boost::shared_ptr<boost::thread> thread(new boost::thread(
-				boost::bind(&asio::io_service::run, io_services_[i])));
+				boost::bind(&run_on_node, io_services_[i], i % nodes, bind_numa_ && nodes > 1)));
 			threads_.push_back(thread);
 		}
 		running_ = true;
@@ -92,6 +108,15 @@ namespace AsioModel{
 		return io_service;
 	}
 
+	/// <summary>
+	/// Pin each io_service thread to a NUMA node.
+	/// </summary>
+	/// <param name="bind">Whether to pin.</param>
+	void IoServicePool::setnumabinding( bool bind )
+	{
+		bind_numa_ = bind;
+	}
+
 	/// <summary>
 	/// Set the specified pool_size.
 	/// </summary>
@@ -92,6 +92,9 @@ namespace AsioModel{
 		void Send(std::string& message, bool callback = false);
 
 		void Send( const char* buf, bool callback = false);
+
+		/// Sends a slice without copying it; the queued slice keeps its storage alive until written
+		void Send(const BaseLib::BufferSlice& slice, bool callback = false);
 		
 
 		/// <summary>
@@ -135,11 +138,13 @@ namespace AsioModel{
 		}
 		
 	private:
+		void asyncRead();
+
 		void handle_read(const boost::system::error_code& e,
 			std::size_t bytes_transferred);
 
 		/// Handle completion of a write operation.
-		void handle_write(const boost::system::error_code& e,std::string* pSendMsg);
+		void handle_write(const boost::system::error_code& e);
 
 		/// <summary>
 		/// The socket_
@@ -147,13 +152,6 @@ namespace AsioModel{
 		/// Socket for the connection.
 		boost::asio::ip::tcp::socket socket_;
 
-		/// <summary>
-		/// The read buffer_
-		/// </summary>
-		/// Buffer for incoming data.
-
-		boost::array<char, 2048> readBuffer_;
-
 		/// <summary>
 		/// The receive msgbuffer_
 		/// </summary>
@@ -162,7 +160,7 @@ namespace AsioModel{
 		/// <summary>
 		/// The send list_
 		/// </summary>
-		std::deque<std::string*>	sendList_;
+		std::deque<BaseLib::BufferSlice>	sendList_;
 
 		/// <summary>
 		/// The send complete call back list_
@@ -1,72 +1,171 @@
 #include "Buffer.h"
-#include <stdio.h>
+#include "BufferPool.h"
+#include "ByteSearch.h"
+#include "FileWriter.h"
+#include "MappedFile.h"
+#ifndef WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
 
 namespace BaseLib
 {
 
+namespace
+{
+
+/// returns a block detached into a BufferSlice to the releasing thread's pool
+struct BlockRelease
+{
+    explicit BlockRelease(size_t capacity)
+        :   capacity_(capacity)
+    {
+    }
+
+    void operator()(const void* block) const
+    {
+        BufferPool::deallocate(static_cast<char*>(const_cast<void*>(block)), capacity_);
+    }
+
+    size_t capacity_;
+};
+
+}
+
 const size_t Buffer::kCheapPrepend = 8;
 const size_t Buffer::kInitialSize = 1024;
+const size_t Buffer::kReadOverflowSize = 65536;
 const char Buffer::kCRLF[] = "\r\n";
 const char Buffer::kCRLFCRLF[] = "\r\n\r\n";
 
 Buffer::Buffer()
-    :   readerIndex_(kCheapPrepend),
-        writerIndex_(kCheapPrepend)
+    :   buffer_(NULL),
+        capacity_(BufferPool::roundUp(kInitialSize+kCheapPrepend)),
+        readerIndex_(kCheapPrepend),
+        writerIndex_(kCheapPrepend),
+        crlfScanned_(kCheapPrepend),
+        crlfcrlfScanned_(kCheapPrepend),
+        eolScanned_(kCheapPrepend)
 {
-    buffer_.assign(kInitialSize+kCheapPrepend,0);
+    buffer_ = BufferPool::allocate(capacity_);
     assert(readableBytes() == 0);
-    assert(writableBytes() == kInitialSize);
+    // the block's slack past kInitialSize is writable too
+    assert(writableBytes() >= kInitialSize);
     assert(prependableBytes() == kCheapPrepend);
 }
 
+Buffer::~Buffer()
+{
+    BufferPool::deallocate(buffer_, capacity_);
+}
+
 Buffer::Buffer(const Buffer& copy)
+    :   buffer_(BufferPool::allocate(copy.capacity_)),
+        capacity_(copy.capacity_),
+        readerIndex_(copy.readerIndex_),
+        writerIndex_(copy.writerIndex_),
+        crlfScanned_(copy.crlfScanned_),
+        crlfcrlfScanned_(copy.crlfcrlfScanned_),
+        eolScanned_(copy.eolScanned_)
 {
-    buffer_ = copy.buffer_;
-    readerIndex_ = copy.readerIndex_;
-    writerIndex_ = copy.writerIndex_;
+    ::memcpy(begin()+readerIndex_, copy.peek(), readableBytes());
 }
 
 Buffer& Buffer::operator =(const Buffer &copy)
 {
-    buffer_ = copy.buffer_;
-    readerIndex_ = copy.readerIndex_;
-    writerIndex_ = copy.writerIndex_;
+    if (this != &copy)
+    {
+        Buffer tmp(copy);
+        swap(tmp);
+    }
     return *this;
 }
 
 void Buffer::swap(Buffer& rhs)
 {
-    buffer_.swap(rhs.buffer_);
+    std::swap(buffer_, rhs.buffer_);
+    std::swap(capacity_, rhs.capacity_);
     std::swap(readerIndex_, rhs.readerIndex_);
     std::swap(writerIndex_, rhs.writerIndex_);
+    std::swap(crlfScanned_, rhs.crlfScanned_);
+    std::swap(crlfcrlfScanned_, rhs.crlfcrlfScanned_);
+    std::swap(eolScanned_, rhs.eolScanned_);
 }
 
 const char* Buffer::findCRLF() const
 {
-    const char* crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF+2);
-    return crlf == beginWrite() ? NULL : crlf;
+    return resumeSearch(crlfScanned_, peek(), kCRLF, 2);
 }
 
 const char* Buffer::findCRLF(const char* start) const
 {
     assert(peek() <= start);
     assert(start <= beginWrite());
-    const char* crlf = std::search(start, beginWrite(), kCRLF, kCRLF+2);
-    return crlf == beginWrite() ? NULL : crlf;
+    return resumeSearch(crlfScanned_, start, kCRLF, 2);
 }
+
+const char* Buffer::findCRLFCRLF() const
+{
+    return resumeSearch(crlfcrlfScanned_, peek(), kCRLFCRLF, 4);
+}
+
 const char* Buffer::findEOL() const
 {
-    const void* eol = memchr(peek(), '\n', readableBytes());
-    return static_cast<const char*>(eol);
+    return findEOL(peek());
 }
 
 const char* Buffer::findEOL(const char* start) const
 {
     assert(peek() <= start);
     assert(start <= beginWrite());
-    const void* eol = memchr(start, '\n', readableBytes());
+    const char* scanned = begin() + std::max(eolScanned_, readerIndex_);
+    const char* from = std::max(start, scanned);
+    const void* eol = memchr(from, '\n', beginWrite() - from);
+    if (start <= scanned)
+    {
+        eolScanned_ = eol ? static_cast<const char*>(eol) - begin() : writerIndex_;
+    }
     return static_cast<const char*>(eol);
 }
+
+const char* Buffer::resumeSearch(size_t& cursor, const char* start,
+                                 const char* delim, size_t len) const
+{
+    const char* scanned = begin() + std::max(cursor, readerIndex_);
+    const char* from = std::max(start, scanned);
+    const char* found = searchBytes(from, beginWrite(), delim, len);
+    // a search that began past the cursor leaves a gap, so it proves nothing
+    if (start <= scanned)
+    {
+        if (found)
+        {
+            cursor = found - begin();
+        }
+        else
+        {
+            // the last len-1 bytes may be the head of a delimiter still in flight
+            size_t tail = std::min(static_cast<size_t>(beginWrite() - from), len - 1);
+            cursor = writerIndex_ - tail;
+        }
+    }
+    return found;
+}
+
+void Buffer::resetScanned()
+{
+    crlfScanned_ = readerIndex_;
+    crlfcrlfScanned_ = readerIndex_;
+    eolScanned_ = readerIndex_;
+}
+
+void Buffer::shiftScanned(size_t offset)
+{
+    crlfScanned_ = std::max(crlfScanned_, readerIndex_) - offset;
+    crlfcrlfScanned_ = std::max(crlfcrlfScanned_, readerIndex_) - offset;
+    eolScanned_ = std::max(eolScanned_, readerIndex_) - offset;
+}
+
 void Buffer::retrieve(size_t len)
 {
     assert(len <= readableBytes());
@@ -84,6 +183,7 @@ void Buffer::retrieveAll()
 {
     readerIndex_ = kCheapPrepend;
     writerIndex_ = kCheapPrepend;
+    resetScanned();
 }
 
 void Buffer::append(const char* data, size_t len)
@@ -108,40 +208,157 @@ void Buffer::append(const Buffer& data)
     append(data.peek(),data.readableBytes());
 }
 
-bool Buffer::appendFromFile(const string path,const string mode)
+void Buffer::appendInt32Array(const int32_t* values, size_t count)
 {
-    FILE* pfile = fopen(path.c_str(),mode.c_str());
-    int32_t nlength = 0;
-    if(pfile)
+    ensureWritableBytes(count*sizeof(int32_t));
+    sockets::hostToNetwork32Array(beginWrite(), values, count);
+    hasWritten(count*sizeof(int32_t));
+}
+
+void Buffer::appendVarint32(uint32_t x)
+{
+    ensureWritableBytes(kMaxVarint32Bytes);
+    hasWritten(encodeVarint32(x, beginWrite()));
+}
+
+void Buffer::appendVarint64(uint64_t x)
+{
+    ensureWritableBytes(kMaxVarint64Bytes);
+    hasWritten(encodeVarint64(x, beginWrite()));
+}
+
+void Buffer::appendVarint32Array(const uint32_t* values, size_t count)
+{
+    ensureWritableBytes(count*kMaxVarint32Bytes);
+    hasWritten(encodeVarint32Array(values, count, beginWrite()));
+}
+
+bool Buffer::appendFromFile(const string path,const string)
+{
+    // mapped rather than read through stdio: the size comes from the
+    // mapping, not from ftell() into a 32-bit length, and the bytes are
+    // copied once, straight from the page cache
+    MappedFile file(path);
+    const uint64_t length = file.size();
+    if (!file.valid() || length == 0)
     {
-        fseek(pfile,0,SEEK_END);
-        nlength = ftell(pfile);
-        if( nlength <= 0)
-        {
-            fclose(pfile);
-            return false;
-        }
-        fseek(pfile,0,SEEK_SET);
-        ensureWritableBytes(nlength);
-        fread(beginWrite(),sizeof (int8_t),nlength,pfile);
-        hasWritten(nlength);
-        fclose(pfile);
-		return true;
+        return false;
     }
-    return false;
+    file.adviseSequential();
+    append(file.data(), static_cast<size_t>(length));
+    return true;
 }
 
 size_t Buffer::dumpToFile(const string path, const string mode)
 {
-    FILE* pfile = fopen(path.c_str(),mode.c_str());
-    size_t nlength = 0;
-    if(pfile)
+    // only the plain truncate and append modes: anything else, "r+" say,
+    // would otherwise silently truncate the file
+    const bool append = mode == "a" || mode == "ab";
+    if (!append && mode != "w" && mode != "wb")
     {
-        nlength = fwrite(peek(),sizeof (int8_t),readableBytes(),pfile);
-        retrieveAll();
-        fclose(pfile);
+        return 0;
     }
-    return nlength;
+    FileWriter writer(path, append);
+    writer.append(peek(), readableBytes());
+    writer.close();
+    if(!writer.ok())
+    {
+        return 0;
+    }
+    retrieveAll();
+    return writer.writtenBytes();
+}
+
+#ifndef WIN32
+ssize_t Buffer::readFd(int fd, int* savedErrno)
+{
+    char overflow[kReadOverflowSize];
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = beginWrite();
+    vec[0].iov_len = writable;
+    vec[1].iov_base = overflow;
+    vec[1].iov_len = sizeof overflow;
+    // a tail at least as large as the overflow area is enough on its own
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = (writable < sizeof overflow) ? 2 : 1;
+    // MSG_DONTWAIT rather than O_NONBLOCK on the socket, which would change
+    // it for every other user of the fd
+    const ssize_t n = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+    if (n < 0)
+    {
+        *savedErrno = errno;
+    }
+    else if (static_cast<size_t>(n) <= writable)
+    {
+        hasWritten(n);
+    }
+    else
+    {
+        hasWritten(writable);
+        append(overflow, n - writable);
+    }
+    return n;
+}
+#endif
+
+void Buffer::readInt32Array(int32_t* values, size_t count)
+{
+    assert(readableBytes() >= count*sizeof(int32_t));
+    sockets::networkToHost32Array(values, peek(), count);
+    retrieve(count*sizeof(int32_t));
+}
+
+bool Buffer::readVarint32(uint32_t& x)
+{
+    size_t len = decodeVarint32(peek(), beginWrite(), &x);
+    if (len > 0)
+    {
+        retrieve(len);
+    }
+    return len > 0;
+}
+
+bool Buffer::readVarint64(uint64_t& x)
+{
+    size_t len = decodeVarint64(peek(), beginWrite(), &x);
+    if (len > 0)
+    {
+        retrieve(len);
+    }
+    return len > 0;
+}
+
+bool Buffer::readZigZag32(int32_t& x)
+{
+    uint32_t encoded = 0;
+    if (!readVarint32(encoded))
+    {
+        return false;
+    }
+    x = zigZagDecode32(encoded);
+    return true;
+}
+
+bool Buffer::readZigZag64(int64_t& x)
+{
+    uint64_t encoded = 0;
+    if (!readVarint64(encoded))
+    {
+        return false;
+    }
+    x = zigZagDecode64(encoded);
+    return true;
+}
+
+size_t Buffer::readVarint32Array(uint32_t* values, size_t count)
+{
+    size_t consumed = 0;
+    size_t n = decodeVarint32Array(peek(), beginWrite(), values, count, &consumed);
+    retrieve(consumed);
+    return n;
 }
 
 string Buffer::readAllAsString()
@@ -160,6 +377,35 @@ string Buffer::readAsString(size_t len)
     return result;
 }
 
+BufferSlice Buffer::readAllAsSlice()
+{
+    return readAsSlice(readableBytes());
+}
+
+BufferSlice Buffer::readAsSlice(size_t len)
+{
+    if(len > readableBytes())
+    {
+        len = readableBytes();
+    }
+    if(len == 0)
+    {
+        return BufferSlice();
+    }
+    char* block = buffer_;
+    size_t blockCapacity = capacity_;
+    const char* data = peek();
+    size_t remaining = readableBytes() - len;
+    capacity_ = BufferPool::roundUp(kCheapPrepend+std::max(kInitialSize, remaining));
+    buffer_ = BufferPool::allocate(capacity_);
+    ::memcpy(buffer_+kCheapPrepend, data+len, remaining);
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + remaining;
+    resetScanned();
+    // the block belongs to the slice from here on, even if this throws
+    return BufferSlice(boost::shared_ptr<const void>(block, BlockRelease(blockCapacity)), data, len);
+}
+
 const char* Buffer::readUntilCRLF(string& outLine)
 {
     outLine.clear();
@@ -176,8 +422,7 @@ const char* Buffer::readUntilCRLF(string& outLine)
 const char* Buffer::readUntilCRLFCRLF(string& outLine)
 {
     outLine.clear();
-    const char* crlf2 = std::search(peek(), (const char*)beginWrite(), kCRLFCRLF+0, kCRLFCRLF+4);
-    crlf2 = (crlf2 == beginWrite())?NULL:crlf2;
+    const char* crlf2 = findCRLFCRLF();
     if(crlf2)
     {
         assert( crlf2 < beginWrite());
@@ -202,8 +447,7 @@ const char* Buffer::peekUntilCRLF(string& outLine)
 const char* Buffer::peekUntilCRLFCRLF(string& outLine)
 {
     outLine.clear();
-    const char* crlf2 = std::search(peek(), (const char*)beginWrite(), kCRLFCRLF+0, kCRLFCRLF+4);
-    crlf2 = (crlf2 == beginWrite())?NULL:crlf2;
+    const char* crlf2 = findCRLFCRLF();
     if(crlf2)
     {
         assert( crlf2 < beginWrite());
@@ -218,15 +462,12 @@ void Buffer::prepend(const void* data, size_t len)
     readerIndex_ -= len;
     const char* d = static_cast<const char*>(data);
     std::copy(d, d+len, begin()+readerIndex_);
+    resetScanned();
 }
 
 void Buffer::shrink(size_t reserve)
 {
-    // FIXME: use vector::shrink_to_fit() in C++ 11 if possible.
-    Buffer other;
-    other.ensureWritableBytes(readableBytes()+reserve);
-    other.append(readAllAsString());
-    swap(other);
+    reallocate(kCheapPrepend+readableBytes()+reserve);
 }
 
 void Buffer::ensureWritableBytes(size_t len)
@@ -243,14 +484,17 @@ void Buffer::makeSpace(size_t len)
 
     if (writableBytes() + prependableBytes() < len + kCheapPrepend)
     {
-        // FIXME: move readable data
-        buffer_.resize(writerIndex_+len+kCheapPrepend,0);
+        // grow geometrically so a stream of appends costs amortized O(1);
+        // the readable bytes are compacted to the front on the way
+        size_t payload = std::max((capacity_-kCheapPrepend)*2, readableBytes()+len);
+        reallocate(kCheapPrepend+payload);
     }
     else
     {
         // move readable data to the front, make space inside buffer
         assert(kCheapPrepend < readerIndex_);
         size_t readable = readableBytes();
+        shiftScanned(readerIndex_ - kCheapPrepend);
         std::copy(begin()+readerIndex_,
                   begin()+writerIndex_,
                   begin()+kCheapPrepend);
@@ -261,4 +505,19 @@ void Buffer::makeSpace(size_t len)
     }
 }
 
+void Buffer::reallocate(size_t newCapacity)
+{
+    size_t readable = readableBytes();
+    newCapacity = BufferPool::roundUp(newCapacity);
+    assert(newCapacity >= kCheapPrepend + readable);
+    char* newBuffer = BufferPool::allocate(newCapacity);
+    ::memcpy(newBuffer+kCheapPrepend, peek(), readable);
+    BufferPool::deallocate(buffer_, capacity_);
+    shiftScanned(readerIndex_ - kCheapPrepend);
+    buffer_ = newBuffer;
+    capacity_ = newCapacity;
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+}
+
 }
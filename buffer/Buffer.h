@@ -7,6 +7,12 @@
 #include <assert.h>
 #include <string>
 #include "stdint.h"
+#ifndef WIN32
+#include <sys/types.h>
+#endif
+#include "BufferSlice.h"
+#include "ByteOrder.h"
+#include "Varint.h"
 using namespace std;
 
 /// A buffer class modeled after org.jboss.netty.buffer.ChannelBuffer
@@ -28,9 +34,11 @@ class Buffer
 public:
     static const size_t kCheapPrepend;
     static const size_t kInitialSize;
+    static const size_t kReadOverflowSize;
 
     Buffer();
-    //  deep copy-ctor, dtor and assignment are fine
+    ~Buffer();
+    //  deep copy
     Buffer(const Buffer &copy);
 
     Buffer& operator = (const Buffer &copy);
@@ -41,6 +49,8 @@ public:
 
     const char* findCRLF(const char* start) const;
 
+    const char* findCRLFCRLF() const;
+
     const char* findEOL() const;
 
     const char* findEOL(const char* start) const;
@@ -51,6 +61,11 @@ public:
 
     void retrieve(size_t len);
 
+    void retrieveInt64()
+    {
+        retrieve(sizeof(int64_t));
+    }
+
     void retrieveInt32()
     {
         retrieve(sizeof(int32_t));
@@ -97,7 +112,7 @@ public:
 
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        return capacity_ - writerIndex_;
     }
 
     size_t prependableBytes() const
@@ -106,17 +121,23 @@ public:
     }
 
     ///
-    /// Append
+    /// Append int using network endian
     ///
+    void appendInt64(int64_t x)
+    {
+        int64_t be64 = sockets::hostToNetwork64(x);
+        append(&be64, sizeof be64);
+    }
+
     void appendInt32(int32_t x)
     {
-        int32_t be32 = x;
+        int32_t be32 = sockets::hostToNetwork32(x);
         append(&be32, sizeof be32);
     }
 
     void appendInt16(int16_t x)
     {
-        int16_t be16 = x;
+        int16_t be16 = sockets::hostToNetwork16(x);
         append(&be16, sizeof be16);
     }
 
@@ -125,10 +146,47 @@ public:
         append(&x, sizeof x);
     }
 
+    void appendInt32Array(const int32_t* values, size_t count);
+
+    ///
+    /// Append LEB128 varint, zigzag for signed values
+    ///
+    void appendVarint32(uint32_t x);
+
+    void appendVarint64(uint64_t x);
+
+    void appendZigZag32(int32_t x)
+    {
+        appendVarint32(zigZagEncode32(x));
+    }
+
+    void appendZigZag64(int64_t x)
+    {
+        appendVarint64(zigZagEncode64(x));
+    }
+
+    void appendVarint32Array(const uint32_t* values, size_t count);
+
+    /// Writes the readable bytes to path and retrieves them. mode is "w"/"wb"
+    /// to truncate or "a"/"ab" to append; any other mode, or a failed
+    /// write, returns 0 and leaves the buffer as it was.
     size_t dumpToFile(const string path,const string mode);
 
+    /// Appends the whole file at path, however large. mode is ignored: the
+    /// file is always mapped read-only. false if it cannot be opened or is
+    /// empty.
     bool appendFromFile(const string path,const string mode);
 
+#ifndef WIN32
+    /// Reads whatever the socket fd has with a single recvmsg(): into the
+    /// writable tail first, then into a kReadOverflowSize area on the
+    /// calling thread's stack which is appended only if it was used. The
+    /// read never blocks, whether or not fd is in non-blocking mode; with
+    /// nothing to read it fails with EAGAIN. Returns the recvmsg() result;
+    /// on error *savedErrno holds errno.
+    ssize_t readFd(int fd, int* savedErrno);
+#endif
+
     void append(const char* /*restrict*/ data, size_t len);
 
     void append(const void* /*restrict*/ data, size_t len);
@@ -140,6 +198,13 @@ public:
     ///
     /// Read
     ///
+    int64_t readInt64()
+    {
+        int64_t result = peekInt64();
+        retrieveInt64();
+        return result;
+    }
+
     int32_t readInt32()
     {
         int32_t result = peekInt32();
@@ -161,10 +226,34 @@ public:
         return result;
     }
 
+    void readInt32Array(int32_t* values, size_t count);
+
+    /// false, with nothing consumed, while the readable bytes do not start
+    /// with a complete varint (see Varint.h for telling short from malformed)
+    bool readVarint32(uint32_t& x);
+
+    bool readVarint64(uint64_t& x);
+
+    bool readZigZag32(int32_t& x);
+
+    bool readZigZag64(int64_t& x);
+
+    /// decodes up to count varints, stops at the first incomplete one
+    /// and returns how many were read
+    size_t readVarint32Array(uint32_t* values, size_t count);
+
     string readAllAsString();
 
     string readAsString(size_t len);
 
+    /// Hands the readable bytes over without copying: the storage block
+    /// itself moves into the slice and this Buffer continues on a fresh
+    /// block. When only len of them are taken, the bytes left behind are
+    /// copied to the new block.
+    BufferSlice readAllAsSlice();
+
+    BufferSlice readAsSlice(size_t len);
+
     ///  outline\r\nֶ
     const char* readUntilCRLF(string &outLine);
     ///  outline\r\nֶ
@@ -174,12 +263,20 @@ public:
     /// Peek
     ///
 
+    int64_t peekInt64() const
+    {
+        assert(readableBytes() >= sizeof(int64_t));
+        int64_t be64 = 0;
+        ::memcpy(&be64, peek(), sizeof be64);
+        return sockets::networkToHost64(be64);
+    }
+
     int32_t peekInt32() const
     {
         assert(readableBytes() >= sizeof(int32_t));
         int32_t be32 = 0;
         ::memcpy(&be32, peek(), sizeof be32);
-        return be32;
+        return sockets::networkToHost32(be32);
     }
 
     int16_t peekInt16() const
@@ -187,7 +284,7 @@ public:
         assert(readableBytes() >= sizeof(int16_t));
         int16_t be16 = 0;
         ::memcpy(&be16, peek(), sizeof be16);
-        return be16;
+        return sockets::networkToHost16(be16);
     }
 
     int8_t peekInt8() const
@@ -202,17 +299,23 @@ public:
     const char* peekUntilCRLFCRLF(string &outLine);
 
     ///
-    /// Prepend int32_t using network endian
+    /// Prepend int using network endian
     ///
+    void prependInt64(int64_t x)
+    {
+        int64_t be64 = sockets::hostToNetwork64(x);
+        prepend(&be64, sizeof be64);
+    }
+
     void prependInt32(int32_t x)
     {
-        int32_t be32 = x;
+        int32_t be32 = sockets::hostToNetwork32(x);
         prepend(&be32, sizeof be32);
     }
 
     void prependInt16(int16_t x)
     {
-        int16_t be16 = x;
+        int16_t be16 = sockets::hostToNetwork16(x);
         prepend(&be16, sizeof be16);
     }
 
@@ -227,27 +330,56 @@ public:
 
     void ensureWritableBytes(size_t len);
 
+    size_t internalCapacity() const
+    {
+        return capacity_;
+    }
+
 private:
 
     char* begin()
     {
-        return &*buffer_.begin();
+        return buffer_;
     }
 
     const char* begin() const
     {
-        return &*buffer_.begin();
+        return buffer_;
     }
 
 
     void makeSpace(size_t len);
 
+    /// Moves the readable bytes to kCheapPrepend of a new, uninitialized
+    /// block of newCapacity bytes.
+    void reallocate(size_t newCapacity);
+
+    /// Searches [max(from, cursor), beginWrite()) for delim and moves the
+    /// cursor to the first position that may still start a match.
+    const char* resumeSearch(size_t& cursor, const char* from,
+                             const char* delim, size_t len) const;
+
+    void resetScanned();
+
+    void shiftScanned(size_t offset);
+
 private:
 
-    std::vector<char> buffer_;
+    /// grown geometrically and never value-initialized: every byte in
+    /// [readerIndex_, writerIndex_) was written by append/prepend first;
+    /// blocks come from and go back to the thread's BufferPool
+    char* buffer_;
+    size_t capacity_;
     size_t readerIndex_;
     size_t writerIndex_;
 
+    /// Per-delimiter "scanned up to" indices into buffer_: no delimiter
+    /// starts in [readerIndex_, cursor), so repeated find*() calls on a
+    /// growing partial frame only look at the newly appended bytes.
+    mutable size_t crlfScanned_;
+    mutable size_t crlfcrlfScanned_;
+    mutable size_t eolScanned_;
+
     static const char kCRLF[];
     static const char kCRLFCRLF[];
 };
@@ -0,0 +1,174 @@
+// Allocation-heavy Buffer workloads, run on the current Buffer and on
+// LegacyBuffer, which is the std::vector<char> storage Buffer had before:
+// zero-filled on construction, grown by resize(writerIndex+len) with a
+// zero fill and no geometric growth.
+//
+//   g++ -O2 -I.. BufferGrowthBench.cpp Buffer.cpp BufferPool.cpp BufferSlice.cpp
+//       SizeClassAllocator.cpp Numa.cpp ByteSearch.cpp ByteOrder.cpp Varint.cpp
+//       FileWriter.cpp MappedFile.cpp -lboost_thread -o buffer_growth_bench
+//
+// Times are ns per buffer for churn and live buffers, ns per 4 MB message
+// for growth.
+
+#include "Buffer.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace BaseLib;
+
+namespace
+{
+
+class LegacyBuffer
+{
+public:
+    LegacyBuffer()
+        :   readerIndex_(Buffer::kCheapPrepend),
+            writerIndex_(Buffer::kCheapPrepend)
+    {
+        buffer_.assign(Buffer::kInitialSize + Buffer::kCheapPrepend, 0);
+    }
+
+    size_t readableBytes() const
+    {
+        return writerIndex_ - readerIndex_;
+    }
+
+    void retrieveAll()
+    {
+        readerIndex_ = Buffer::kCheapPrepend;
+        writerIndex_ = Buffer::kCheapPrepend;
+    }
+
+    void append(const char* data, size_t len)
+    {
+        if (buffer_.size() - writerIndex_ < len)
+        {
+            makeSpace(len);
+        }
+        std::copy(data, data + len, &buffer_[0] + writerIndex_);
+        writerIndex_ += len;
+    }
+
+private:
+    void makeSpace(size_t len)
+    {
+        if (buffer_.size() - writerIndex_ + readerIndex_ < len + Buffer::kCheapPrepend)
+        {
+            buffer_.resize(writerIndex_ + len + Buffer::kCheapPrepend, 0);
+        }
+        else
+        {
+            size_t readable = readableBytes();
+            std::copy(&buffer_[0] + readerIndex_, &buffer_[0] + writerIndex_,
+                      &buffer_[0] + Buffer::kCheapPrepend);
+            readerIndex_ = Buffer::kCheapPrepend;
+            writerIndex_ = readerIndex_ + readable;
+        }
+    }
+
+    std::vector<char> buffer_;
+    size_t readerIndex_;
+    size_t writerIndex_;
+};
+
+double nowSeconds()
+{
+    static const boost::posix_time::ptime epoch = boost::posix_time::microsec_clock::universal_time();
+    return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+}
+
+char g_chunk[4096];
+size_t g_sink = 0;
+
+/// a short-lived connection: one buffer, one small message
+template <class B>
+void churn(int rounds)
+{
+    for (int i = 0; i < rounds; ++i)
+    {
+        B b;
+        b.append(g_chunk, 200);
+        g_sink += b.readableBytes();
+    }
+}
+
+/// one large message arriving in 512-byte reads
+template <class B>
+void growth(int rounds)
+{
+    for (int i = 0; i < rounds; ++i)
+    {
+        B b;
+        for (size_t n = 0; n < 4 * 1024 * 1024; n += 512)
+        {
+            b.append(g_chunk, 512);
+        }
+        g_sink += b.readableBytes();
+    }
+}
+
+/// many idle connections, each holding a buffer with a little data
+template <class B>
+void manyLive(int count)
+{
+    std::vector<B*> live;
+    live.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        live.push_back(new B);
+        live.back()->append(g_chunk, 64);
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        g_sink += live[i]->readableBytes();
+        delete live[i];
+    }
+}
+
+/// after one untimed round, so that glibc has settled its mmap threshold
+/// and the pools their caches before either storage is measured
+double timeIt(void (*run)(int), int n)
+{
+    run(n);
+    const double start = nowSeconds();
+    run(n);
+    return nowSeconds() - start;
+}
+
+void report(const char* name, double legacy, double current, int n)
+{
+    printf("%-34s %10.1f %10.1f %8.2fx\n", name, legacy * 1e9 / n, current * 1e9 / n,
+           current > 0 ? legacy / current : 0.0);
+}
+
+}
+
+int main()
+{
+    memset(g_chunk, 'x', sizeof g_chunk);
+    printf("%-34s %10s %10s %9s\n", "ns per unit", "legacy", "current", "speedup");
+
+    // one statement each: the order function arguments are evaluated in
+    // is unspecified, and whichever storage runs first leaves malloc in a
+    // different state for the other
+    const int kChurn = 2000000;
+    double legacy = timeIt(churn<LegacyBuffer>, kChurn);
+    double current = timeIt(churn<Buffer>, kChurn);
+    report("churn: construct+200B+destroy", legacy, current, kChurn);
+
+    const int kGrowth = 50;
+    legacy = timeIt(growth<LegacyBuffer>, kGrowth);
+    current = timeIt(growth<Buffer>, kGrowth);
+    report("growth: 4 MB in 512B appends", legacy, current, kGrowth);
+
+    const int kLive = 1000000;
+    legacy = timeIt(manyLive<LegacyBuffer>, kLive);
+    current = timeIt(manyLive<Buffer>, kLive);
+    report("1M live buffers, 64B each", legacy, current, kLive);
+
+    return g_sink == 0;
+}
@@ -0,0 +1,235 @@
+#include "BufferPool.h"
+#include "Buffer.h"
+#include "SizeClassAllocator.h"
+#include "Numa.h"
+#include "ThreadLocal.h"
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace BaseLib
+{
+
+const size_t BufferPool::kNumClasses;
+const size_t BufferPool::kDefaultMaxCachedBytes;
+
+namespace
+{
+
+/// read by every thread on every push, so relaxed: a thread that sees a
+/// new cap a little late only caches a block more or less
+boost::atomic<size_t> g_maxCachedBytes(BufferPool::kDefaultMaxCachedBytes);
+
+/// Buffer's first capacity rounded up to the SizeClassAllocator class it
+/// is carved from. A Buffer made during static initialization, before
+/// this is set, sees 0: it gets an exact-size block straight from
+/// SizeClassAllocator and bypasses the cache, which is harmless.
+const size_t g_firstClass = SizeClassAllocator::roundUp(Buffer::kCheapPrepend + Buffer::kInitialSize);
+
+/// Twice a SizeClassAllocator class is again a class (up to its kMaxSize;
+/// the large blocks beyond are exact), so every block Buffer grows
+/// through is used to the last byte.
+size_t classSize(size_t index)
+{
+    return g_firstClass << index;
+}
+
+/// index of the class whose size is exactly capacity, or kNumClasses
+size_t classIndex(size_t capacity)
+{
+    for (size_t i = 0; i < BufferPool::kNumClasses; ++i)
+    {
+        if (classSize(i) == capacity)
+        {
+            return i;
+        }
+    }
+    return BufferPool::kNumClasses;
+}
+
+/// cached blocks are linked through their own first bytes
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+class ThreadCache : boost::noncopyable
+{
+public:
+    /// *self is the thread's fast pointer to this cache, cleared again
+    /// when the thread exits
+    explicit ThreadCache(ThreadCache** self)
+        :   self_(self),
+            cachedBytes_(0)
+    {
+        for (size_t i = 0; i < BufferPool::kNumClasses; ++i)
+        {
+            freeLists_[i] = NULL;
+        }
+    }
+
+    ~ThreadCache()
+    {
+        trim();
+        *self_ = NULL;
+    }
+
+    char* pop(size_t index)
+    {
+        FreeBlock* block = freeLists_[index];
+        if (block)
+        {
+            freeLists_[index] = block->next;
+            cachedBytes_ -= classSize(index);
+        }
+        return reinterpret_cast<char*>(block);
+    }
+
+    bool push(size_t index, char* p)
+    {
+        if (cachedBytes_ + classSize(index) > g_maxCachedBytes.load(boost::memory_order_relaxed))
+        {
+            return false;
+        }
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(p);
+        block->next = freeLists_[index];
+        freeLists_[index] = block;
+        cachedBytes_ += classSize(index);
+        return true;
+    }
+
+    void trim()
+    {
+        trimTo(0);
+    }
+
+    /// releases blocks, largest first, until at most bytes are cached
+    void trimTo(size_t bytes)
+    {
+        for (size_t i = BufferPool::kNumClasses; i > 0 && cachedBytes_ > bytes; --i)
+        {
+            while (cachedBytes_ > bytes)
+            {
+                char* block = pop(i - 1);
+                if (block == NULL)
+                {
+                    break;
+                }
+                SizeClassAllocator::deallocate(block);
+            }
+        }
+    }
+
+    size_t cachedBytes() const
+    {
+        return cachedBytes_;
+    }
+
+private:
+    ThreadCache** self_;
+    FreeBlock* freeLists_[BufferPool::kNumClasses];
+    size_t cachedBytes_;
+};
+
+/// read on every allocate() and deallocate(), so a plain thread-local
+/// pointer; NULL until the thread first needs its cache
+ThreadCache*& currentCache()
+{
+    static BASELIB_THREAD_LOCAL ThreadCache* cache = NULL;
+    return cache;
+}
+
+ThreadCache& threadCache()
+{
+    ThreadCache*& cache = currentCache();
+    if (cache == NULL)
+    {
+        // the TSS slot is only there to delete the cache when the thread
+        // exits. Never destroyed: Buffers with static storage may be
+        // released after every other static object is gone.
+        static boost::thread_specific_ptr<ThreadCache>* owner =
+            new boost::thread_specific_ptr<ThreadCache>();
+        cache = new ThreadCache(&cache);
+        owner->reset(cache);
+    }
+    return *cache;
+}
+
+}
+
+size_t BufferPool::roundUp(size_t capacity)
+{
+    for (size_t i = 0; i < kNumClasses; ++i)
+    {
+        if (classSize(i) >= capacity)
+        {
+            return classSize(i);
+        }
+    }
+    return capacity;
+}
+
+char* BufferPool::allocate(size_t capacity)
+{
+    size_t index = classIndex(capacity);
+    if (index < kNumClasses)
+    {
+        // the NUMA counters are kept by SizeClassAllocator alone: a block
+        // counts as allocated from when it leaves there until it goes
+        // back, however often the cache hands it out in between
+        char* block = threadCache().pop(index);
+        if (block)
+        {
+            return block;
+        }
+    }
+    return static_cast<char*>(SizeClassAllocator::allocate(capacity));
+}
+
+void BufferPool::deallocate(char* block, size_t capacity)
+{
+    if (block == NULL)
+    {
+        return;
+    }
+    // a block from another node's heap goes home rather than being
+    // handed out again here
+    size_t index = classIndex(capacity);
+    int node = SizeClassAllocator::nodeOf(block);
+    if (index < kNumClasses && (node < 0 || static_cast<size_t>(node) == Numa::currentNode())
+        && threadCache().push(index, block))
+    {
+        return;
+    }
+    SizeClassAllocator::deallocate(block);
+}
+
+void BufferPool::setMaxCachedBytes(size_t bytes)
+{
+    g_maxCachedBytes.store(bytes, boost::memory_order_relaxed);
+    if (ThreadCache* cache = currentCache())
+    {
+        cache->trimTo(bytes);
+    }
+}
+
+size_t BufferPool::maxCachedBytes()
+{
+    return g_maxCachedBytes.load(boost::memory_order_relaxed);
+}
+
+size_t BufferPool::cachedBytes()
+{
+    const ThreadCache* cache = currentCache();
+    return cache == NULL ? 0 : cache->cachedBytes();
+}
+
+void BufferPool::trim()
+{
+    if (ThreadCache* cache = currentCache())
+    {
+        cache->trim();
+    }
+}
+
+}
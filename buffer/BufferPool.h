@@ -0,0 +1,56 @@
+#ifndef _BUFFERPOOL_H
+#define _BUFFERPOOL_H
+
+#include <stddef.h>
+
+/// Thread-local recycling of Buffer storage blocks.
+///
+/// Block sizes come in classes of SizeClassAllocator::roundUp(Buffer::kCheapPrepend
+/// + Buffer::kInitialSize) << i, which is exactly the sequence of capacities
+/// Buffer grows through, and every one of them is a whole SizeClassAllocator
+/// block with no slack behind it. Each
+/// thread keeps a free list per class, bounded by maxCachedBytes() in total,
+/// so a thread that keeps creating and destroying Buffers of similar sizes
+/// reaches a steady state without calling malloc/free. Blocks come from
+/// and overflow to SizeClassAllocator, which hands blocks released on
+/// another thread back to the thread that carved them. Only blocks of the
+/// calling thread's NUMA node are cached; others go straight home.
+
+namespace BaseLib
+{
+
+class BufferPool
+{
+public:
+    static const size_t kNumClasses = 12;
+    static const size_t kDefaultMaxCachedBytes = 4*1024*1024;
+
+    /// Smallest block size able to hold capacity bytes; capacity itself
+    /// when it is larger than every class.
+    static size_t roundUp(size_t capacity);
+
+    /// capacity must have been obtained from roundUp().
+    static char* allocate(size_t capacity);
+
+    static void deallocate(char* block, size_t capacity);
+
+    /// Upper bound on the bytes each thread keeps cached. Lowering it
+    /// trims the calling thread's cache to the new bound right away;
+    /// other threads only stop caching more until they are under it, or
+    /// call trim() themselves.
+    static void setMaxCachedBytes(size_t bytes);
+
+    static size_t maxCachedBytes();
+
+    /// Bytes currently cached by the calling thread.
+    static size_t cachedBytes();
+
+    /// Releases every block cached by the calling thread.
+    static void trim();
+
+private:
+    BufferPool();
+};
+
+}
+#endif  // _BUFFERPOOL_H
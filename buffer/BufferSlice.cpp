@@ -0,0 +1,64 @@
+#include "BufferSlice.h"
+#include "SizeClassAllocator.h"
+#include <assert.h>
+#include <string.h>
+#include <boost/make_shared.hpp>
+
+namespace BaseLib
+{
+
+namespace
+{
+
+struct SizeClassRelease
+{
+    void operator()(const void* block) const
+    {
+        SizeClassAllocator::deallocate(const_cast<void*>(block));
+    }
+};
+
+}
+
+BufferSlice::BufferSlice()
+{
+}
+
+BufferSlice::BufferSlice(const boost::shared_ptr<const void>& owner, const char* data, size_t len)
+    :   owner_(owner),
+        buffer_(data, len)
+{
+}
+
+BufferSlice BufferSlice::fromString(std::string& str)
+{
+    // the string object and its control block share one SizeClassAllocator
+    // block; the bytes stay where str had them
+    boost::shared_ptr<std::string> owner =
+        boost::allocate_shared<std::string>(SizeClassStdAllocator<std::string>());
+    owner->swap(str);
+    return BufferSlice(owner, owner->data(), owner->size());
+}
+
+BufferSlice BufferSlice::copyOf(const char* data, size_t len)
+{
+    char* block = static_cast<char*>(SizeClassAllocator::allocate(len));
+    ::memcpy(block, data, len);
+    // if the control block cannot be allocated the deleter runs at once
+    boost::shared_ptr<const void> owner(block, SizeClassRelease(), SizeClassStdAllocator<char>());
+    return BufferSlice(owner, block, len);
+}
+
+BufferSlice BufferSlice::slice(size_t offset, size_t len) const
+{
+    assert(offset <= size());
+    assert(len <= size() - offset);
+    return BufferSlice(owner_, data() + offset, len);
+}
+
+std::string BufferSlice::toString() const
+{
+    return std::string(data(), size());
+}
+
+}
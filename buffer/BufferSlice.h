@@ -0,0 +1,81 @@
+#ifndef _BUFFERSLICE_H
+#define _BUFFERSLICE_H
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/asio/buffer.hpp>
+
+/// An immutable, refcounted view of bytes owned by someone else.
+///
+/// Buffer::readAsSlice() detaches its storage block into a slice instead
+/// of copying the readable bytes out; slice() narrows a view without
+/// copying, and every view keeps the block alive. A BufferSlice is itself
+/// an asio ConstBufferSequence, so it can be handed to async_write as is.
+
+namespace BaseLib
+{
+
+class BufferSlice
+{
+public:
+    typedef boost::asio::const_buffer value_type;
+    typedef const boost::asio::const_buffer* const_iterator;
+
+    BufferSlice();
+
+    BufferSlice(const boost::shared_ptr<const void>& owner, const char* data, size_t len);
+
+    /// Takes over the contents of str without copying them (str is left
+    /// empty). The only allocation is one SizeClassAllocator block for
+    /// the owner.
+    static BufferSlice fromString(std::string& str);
+
+    /// a copy of data in a SizeClassAllocator block, control block
+    /// included, so no call to the general-purpose heap is made
+    static BufferSlice copyOf(const char* data, size_t len);
+
+    const char* data() const
+    {
+        return boost::asio::buffer_cast<const char*>(buffer_);
+    }
+
+    size_t size() const
+    {
+        return boost::asio::buffer_size(buffer_);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /// a narrower view sharing the same storage
+    BufferSlice slice(size_t offset, size_t len) const;
+
+    std::string toString() const;
+
+    ///
+    /// ConstBufferSequence
+    ///
+    const_iterator begin() const
+    {
+        return &buffer_;
+    }
+
+    const_iterator end() const
+    {
+        return &buffer_ + 1;
+    }
+
+    const boost::asio::const_buffer& asioBuffer() const
+    {
+        return buffer_;
+    }
+
+private:
+    boost::shared_ptr<const void> owner_;
+    boost::asio::const_buffer buffer_;
+};
+
+}
+#endif  // _BUFFERSLICE_H
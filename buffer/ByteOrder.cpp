@@ -0,0 +1,46 @@
+#include "ByteOrder.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BASELIB_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace BaseLib
+{
+namespace sockets
+{
+
+void hostToNetwork32Array(void* dst, const void* src, size_t count)
+{
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if (dst != src)
+    {
+        memmove(dst, src, count * sizeof(uint32_t));
+    }
+#else
+    char* out = static_cast<char*>(dst);
+    const char* in = static_cast<const char*>(src);
+    size_t i = 0;
+#ifdef BASELIB_HAVE_SSE2
+    // swap the 16-bit halves of each lane, then the bytes of each half
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i*4));
+        x = _mm_or_si128(_mm_slli_epi32(x, 16), _mm_srli_epi32(x, 16));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i*4), x);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        uint32_t x;
+        memcpy(&x, in + i*4, sizeof x);
+        x = hostToNetwork32(x);
+        memcpy(out + i*4, &x, sizeof x);
+    }
+#endif
+}
+
+}
+}
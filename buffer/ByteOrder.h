@@ -0,0 +1,56 @@
+#ifndef _BYTEORDER_H
+#define _BYTEORDER_H
+
+#include <stddef.h>
+#include "stdint.h"
+
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+/// Host <-> network (big-endian) byte order conversion.
+
+namespace BaseLib
+{
+namespace sockets
+{
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+
+inline uint64_t hostToNetwork64(uint64_t host64) { return host64; }
+inline uint32_t hostToNetwork32(uint32_t host32) { return host32; }
+inline uint16_t hostToNetwork16(uint16_t host16) { return host16; }
+
+#elif defined(_MSC_VER)
+
+inline uint64_t hostToNetwork64(uint64_t host64) { return _byteswap_uint64(host64); }
+inline uint32_t hostToNetwork32(uint32_t host32) { return _byteswap_ulong(host32); }
+inline uint16_t hostToNetwork16(uint16_t host16) { return _byteswap_ushort(host16); }
+
+#else
+
+inline uint64_t hostToNetwork64(uint64_t host64) { return __builtin_bswap64(host64); }
+inline uint32_t hostToNetwork32(uint32_t host32) { return __builtin_bswap32(host32); }
+inline uint16_t hostToNetwork16(uint16_t host16)
+{
+    return static_cast<uint16_t>((host16 << 8) | (host16 >> 8));
+}
+
+#endif
+
+inline uint64_t networkToHost64(uint64_t net64) { return hostToNetwork64(net64); }
+inline uint32_t networkToHost32(uint32_t net32) { return hostToNetwork32(net32); }
+inline uint16_t networkToHost16(uint16_t net16) { return hostToNetwork16(net16); }
+
+/// Converts count 32-bit values at a time (SSE2 where available);
+/// neither side needs to be aligned and dst may equal src.
+void hostToNetwork32Array(void* dst, const void* src, size_t count);
+
+inline void networkToHost32Array(void* dst, const void* src, size_t count)
+{
+    hostToNetwork32Array(dst, src, count);
+}
+
+}
+}
+#endif  // _BYTEORDER_H
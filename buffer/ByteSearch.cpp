@@ -0,0 +1,229 @@
+#include "ByteSearch.h"
+#include <algorithm>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BASELIB_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(BASELIB_HAVE_SSE2) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) || \
+     (defined(_MSC_VER) && _MSC_VER >= 1700))
+#define BASELIB_HAVE_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BASELIB_TARGET_AVX2
+#else
+#define BASELIB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace BaseLib
+{
+
+namespace
+{
+
+inline unsigned countTrailingZeros(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+/// The SIMD kernels compare the first and the last needle byte against a
+/// whole vector of candidate positions at once and only run memcmp on the
+/// positions where both match; for "\r\n" and "\r\n\r\n" that check is
+/// almost always conclusive.
+inline const char* verifyCandidates(const char* p, unsigned mask,
+                                    const char* needle, size_t len)
+{
+    while (mask)
+    {
+        const char* candidate = p + countTrailingZeros(mask);
+        if (len <= 2 || memcmp(candidate + 1, needle + 1, len - 2) == 0)
+        {
+            return candidate;
+        }
+        mask &= mask - 1;
+    }
+    return NULL;
+}
+
+bool cpuHasAVX2()
+{
+#if defined(BASELIB_HAVE_AVX2) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    // AVX needs both the CPU bit and the OS saving the ymm state (OSXSAVE + XCR0).
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+    {
+        return false;
+    }
+    if ((_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(BASELIB_HAVE_AVX2)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+typedef const char* (*SearchFunc)(const char*, const char*, const char*, size_t);
+
+struct Kernel
+{
+    SearchFunc func;
+    const char* name;
+};
+
+Kernel selectKernel()
+{
+    Kernel k;
+    if (cpuHasAVX2())
+    {
+        k.func = searchBytesAVX2;
+        k.name = "avx2";
+    }
+    else
+    {
+#ifdef BASELIB_HAVE_SSE2
+        k.func = searchBytesSSE2;
+        k.name = "sse2";
+#else
+        k.func = searchBytesScalar;
+        k.name = "scalar";
+#endif
+    }
+    return k;
+}
+
+/// Selected once, by whichever thread gets here first; the others wait
+/// on the static's initialization guard.
+const Kernel& kernel()
+{
+    static const Kernel k = selectKernel();
+    return k;
+}
+
+}
+
+const char* searchBytes(const char* begin, const char* end,
+                        const char* needle, size_t len)
+{
+    return kernel().func(begin, end, needle, len);
+}
+
+const char* searchBytesKernel()
+{
+    return kernel().name;
+}
+
+const char* searchBytesScalar(const char* begin, const char* end,
+                              const char* needle, size_t len)
+{
+    const char* found = std::search(begin, end, needle, needle + len);
+    return (found == end && len != 0) ? NULL : found;
+}
+
+#ifdef BASELIB_HAVE_SSE2
+
+const char* searchBytesSSE2(const char* begin, const char* end,
+                            const char* needle, size_t len)
+{
+    if (len < 2 || static_cast<size_t>(end - begin) < len)
+    {
+        return searchBytesScalar(begin, end, needle, len);
+    }
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    // candidates start in [begin, stop); a block of 16 is safe while p + 16 <= stop
+    const char* stop = end - len + 1;
+    const char* p = begin;
+    while (stop - p >= 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                          _mm_cmpeq_epi8(blockLast, last))));
+        const char* found = verifyCandidates(p, mask, needle, len);
+        if (found)
+        {
+            return found;
+        }
+        p += 16;
+    }
+    return searchBytesScalar(p, end, needle, len);
+}
+
+#else
+
+const char* searchBytesSSE2(const char* begin, const char* end,
+                            const char* needle, size_t len)
+{
+    return searchBytesScalar(begin, end, needle, len);
+}
+
+#endif  // BASELIB_HAVE_SSE2
+
+#ifdef BASELIB_HAVE_AVX2
+
+BASELIB_TARGET_AVX2
+const char* searchBytesAVX2(const char* begin, const char* end,
+                            const char* needle, size_t len)
+{
+    if (len < 2 || static_cast<size_t>(end - begin) < len)
+    {
+        return searchBytesScalar(begin, end, needle, len);
+    }
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+    const char* stop = end - len + 1;
+    const char* p = begin;
+    while (stop - p >= 32)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + len - 1));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+                             _mm256_cmpeq_epi8(blockLast, last))));
+        const char* found = verifyCandidates(p, mask, needle, len);
+        if (found)
+        {
+            return found;
+        }
+        p += 32;
+    }
+    return searchBytesSSE2(p, end, needle, len);
+}
+
+#else
+
+const char* searchBytesAVX2(const char* begin, const char* end,
+                            const char* needle, size_t len)
+{
+    return searchBytesSSE2(begin, end, needle, len);
+}
+
+#endif  // BASELIB_HAVE_AVX2
+
+}
@@ -0,0 +1,37 @@
+#ifndef _BYTESEARCH_H
+#define _BYTESEARCH_H
+
+#include <stddef.h>
+
+/// Delimiter search kernels used by Buffer (CRLF, CRLFCRLF, ...).
+///
+/// searchBytes() picks the widest kernel the running CPU supports the
+/// first time it is called (AVX2, then SSE2, then the scalar fallback).
+/// The individual kernels are exported so they can be benchmarked
+/// against each other; a kernel that was not compiled in falls back to
+/// the scalar one. A kernel that was compiled in is not checked against
+/// the CPU: call searchBytesAVX2() directly only when searchBytesKernel()
+/// says "avx2".
+
+namespace BaseLib
+{
+
+/// Returns the first occurrence of needle[0, len) in [begin, end),
+/// or NULL if there is none.
+const char* searchBytes(const char* begin, const char* end,
+                        const char* needle, size_t len);
+
+const char* searchBytesScalar(const char* begin, const char* end,
+                              const char* needle, size_t len);
+
+const char* searchBytesSSE2(const char* begin, const char* end,
+                            const char* needle, size_t len);
+
+const char* searchBytesAVX2(const char* begin, const char* end,
+                            const char* needle, size_t len);
+
+/// Name of the kernel searchBytes() dispatches to: "avx2", "sse2" or "scalar".
+const char* searchBytesKernel();
+
+}
+#endif  // _BYTESEARCH_H
@@ -1,66 +1,448 @@
 #ifndef COBJPOOL_H
 #define COBJPOOL_H
 
-#include "boost/pool/object_pool.hpp"
-#include "boost/thread/mutex.hpp"
-#include "boost/thread/lock_guard.hpp"
+#include <algorithm>
+#include <new>
+#include <string>
+#include <typeinfo>
+#include "boost/config.hpp"
+#if !defined(BOOST_NO_CXX11_VARIADIC_TEMPLATES) && !defined(BOOST_NO_CXX11_RVALUE_REFERENCES)
+#define BASELIB_OBJPOOL_VARIADIC 1
+#include <utility>
+#endif
+#include "boost/shared_ptr.hpp"
 #include "boost/bind.hpp"
+#include "boost/atomic.hpp"
+#include "boost/type_traits/alignment_of.hpp"
+#include "boost/type_traits/aligned_storage.hpp"
+#include <vector>
+#include "SlotAllocator.h"
+#include "Numa.h"
+#include "PoolStats.h"
 
 namespace BaseLib
 {
 
+template<class T> class CObjPool;
+
+/// A pooled object with its reference count in the same slot.
+template<class T>
+struct PooledNode
+{
+    explicit PooledNode(SlotAllocator* from)
+        : refs(1), slots(from)
+    {
+    }
+
+    T* object()
+    {
+        return static_cast<T*>(static_cast<void*>(&storage));
+    }
+
+    boost::atomic<long> refs;
+    SlotAllocator* slots;
+    typename boost::aligned_storage<sizeof(T), boost::alignment_of<T>::value>::type storage;
+};
+
+/// Intrusively counted pointer to an object made by CObjPool::CreateHandle.
+/// Unlike the shared_ptr from CreateObject it needs no control block of
+/// its own: the count lives next to the object in the pooled slot, so
+/// creating one allocates nothing from the heap. Thread-safe to the same
+/// degree as shared_ptr.
+template<class T>
+class PooledPtr
+{
+    typedef PooledNode<T> Node;
+    typedef Node* PooledPtr::*unspecified_bool_type;
+
+public:
+    PooledPtr()
+        : node_(NULL)
+    {
+    }
+
+    PooledPtr(const PooledPtr& rhs)
+        : node_(rhs.node_)
+    {
+        if(node_)
+        {
+            node_->refs.fetch_add(1, boost::memory_order_relaxed);
+        }
+    }
+
+    ~PooledPtr()
+    {
+        release();
+    }
+
+    PooledPtr& operator = (PooledPtr rhs)
+    {
+        swap(rhs);
+        return *this;
+    }
+
+    void swap(PooledPtr& rhs)
+    {
+        Node* tmp = node_;
+        node_ = rhs.node_;
+        rhs.node_ = tmp;
+    }
+
+    void reset()
+    {
+        release();
+        node_ = NULL;
+    }
+
+    T* get() const
+    {
+        return node_ ? node_->object() : NULL;
+    }
+
+    T& operator*() const
+    {
+        assert(node_);
+        return *node_->object();
+    }
+
+    T* operator->() const
+    {
+        assert(node_);
+        return node_->object();
+    }
+
+    operator unspecified_bool_type() const
+    {
+        return node_ ? &PooledPtr::node_ : NULL;
+    }
+
+    long use_count() const
+    {
+        return node_ ? node_->refs.load(boost::memory_order_relaxed) : 0;
+    }
+
+private:
+    friend class CObjPool<T>;
+
+    /// adopts the reference node was created with
+    explicit PooledPtr(Node* node)
+        : node_(node)
+    {
+    }
+
+    void release()
+    {
+        if(node_ && node_->refs.fetch_sub(1, boost::memory_order_release) == 1)
+        {
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            SlotAllocator* slots = node_->slots;
+            node_->object()->~T();
+            node_->~Node();
+            slots->deallocate(node_);
+        }
+    }
+
+private:
+    Node* node_;
+};
+
+/// Pool of T handed out as shared_ptrs that put the object back when the
+/// last reference goes. The slots come from a SlotAllocator, so creating
+/// and destroying objects normally stays within the calling thread's
+/// magazine and takes no lock. The pool must outlive its objects.
+///
+/// CreateHandle returns a PooledPtr instead, which keeps its count inside
+/// the slot, so no control block is allocated for it either.
+///
+/// On a NUMA host there is one SlotAllocator per node. An object is made
+/// from the slots of the node the calling thread runs on and goes back to
+/// them on whichever thread it is released.
+///
+/// Every pool is listed in PoolRegistry under its name while it exists;
+/// stats() is what the registry reports for it.
 template<class T>
 class CObjPool : boost::noncopyable
 {
 public:
+    typedef PooledPtr<T> Handle;
+
+    CObjPool()
+        : name_(typeid(T).name())
+    {
+        init();
+    }
+
+    /// name is what the pool is listed as in PoolRegistry
+    explicit CObjPool(const std::string& name)
+        : name_(name)
+    {
+        init();
+    }
 
-    CObjPool(){}
+    virtual ~CObjPool()
+    {
+        PoolRegistry::remove(this);
+    }
 
-    virtual ~CObjPool(){}
+#ifdef BASELIB_OBJPOOL_VARIADIC
+    /// constructs T from args, forwarded as they were passed
+    template <class... Args>
+    boost::shared_ptr<T> CreateObject(Args&&... args)
+    {
+        SlotAllocator& slots = localSlots();
+        void* mem = slots.allocate();
+        T* p = NULL;
+        try
+        {
+            p = new (mem) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            slots.deallocate(mem);
+            throw;
+        }
+        return wrap(p, &slots);
+    }
 
+    template <class... Args>
+    Handle CreateHandle(Args&&... args)
+    {
+        PooledNode<T>* node = allocateNode();
+        try
+        {
+            new (node->object()) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            freeNode(node);
+            throw;
+        }
+        return Handle(node);
+    }
+#else
     boost::shared_ptr<T> CreateObject()
     {
-        boost::lock_guard<boost::mutex> lock(mutex_);
-        T* p = pool_.construct();
-        assert(p);
-        boost::shared_ptr<T> ptr(p,boost::bind(&CObjPool::DestroyObject,this,_1) );
-        return ptr;
+        SlotAllocator& slots = localSlots();
+        void* mem = slots.allocate();
+        T* p = NULL;
+        try
+        {
+            p = new (mem) T();
+        }
+        catch (...)
+        {
+            slots.deallocate(mem);
+            throw;
+        }
+        return wrap(p, &slots);
     }
 
     template <class Arg1>
     boost::shared_ptr<T> CreateObject(Arg1 a1)
     {
-        boost::lock_guard<boost::mutex> lock(mutex_);
-        T* p = pool_.construct(a1);
-        assert(p);
-		boost::shared_ptr<T> ptr(p,boost::bind(&CObjPool::DestroyObject,this,_1) );
-        return ptr;
+        SlotAllocator& slots = localSlots();
+        void* mem = slots.allocate();
+        T* p = NULL;
+        try
+        {
+            p = new (mem) T(a1);
+        }
+        catch (...)
+        {
+            slots.deallocate(mem);
+            throw;
+        }
+        return wrap(p, &slots);
     }
 
     template <class Arg1, class Arg2>
     boost::shared_ptr<T> CreateObject(Arg1 a1,Arg2 a2)
     {
-        boost::lock_guard<boost::mutex> lock(mutex_);
-        T* p = pool_.construct(a1,a2);
-        assert(p);
-        boost::shared_ptr<T> ptr(p,boost::bind(&CObjPool::DestroyObject,this,_1) );
-        return ptr;
+        SlotAllocator& slots = localSlots();
+        void* mem = slots.allocate();
+        T* p = NULL;
+        try
+        {
+            p = new (mem) T(a1,a2);
+        }
+        catch (...)
+        {
+            slots.deallocate(mem);
+            throw;
+        }
+        return wrap(p, &slots);
+    }
+
+    Handle CreateHandle()
+    {
+        PooledNode<T>* node = allocateNode();
+        try
+        {
+            new (node->object()) T();
+        }
+        catch (...)
+        {
+            freeNode(node);
+            throw;
+        }
+        return Handle(node);
+    }
+
+    template <class Arg1>
+    Handle CreateHandle(Arg1 a1)
+    {
+        PooledNode<T>* node = allocateNode();
+        try
+        {
+            new (node->object()) T(a1);
+        }
+        catch (...)
+        {
+            freeNode(node);
+            throw;
+        }
+        return Handle(node);
+    }
+
+    template <class Arg1, class Arg2>
+    Handle CreateHandle(Arg1 a1,Arg2 a2)
+    {
+        PooledNode<T>* node = allocateNode();
+        try
+        {
+            new (node->object()) T(a1,a2);
+        }
+        catch (...)
+        {
+            freeNode(node);
+            throw;
+        }
+        return Handle(node);
+    }
+#endif
+
+    /// Pre-carves and prefaults slots for n objects made by CreateObject,
+    /// so start-up traffic does not pay for page faults and slab carving.
+    /// The slots are spread evenly over the NUMA nodes.
+    void reserve(size_t n)
+    {
+        for (size_t i = 0; i < slots_.size(); ++i)
+        {
+            slots_[i]->reserve((n + slots_.size() - 1) / slots_.size());
+        }
+    }
+
+    /// the same for CreateHandle
+    void reserveHandles(size_t n)
+    {
+        for (size_t i = 0; i < nodes_.size(); ++i)
+        {
+            nodes_[i]->reserve((n + nodes_.size() - 1) / nodes_.size());
+        }
+    }
+
+    /// Gives slabs left idle after a traffic spike back to the OS.
+    void trim()
+    {
+        for (size_t i = 0; i < slots_.size(); ++i)
+        {
+            slots_[i]->trim();
+            nodes_[i]->trim();
+        }
+    }
+
+    /// Objects from CreateObject and CreateHandle together, over all
+    /// NUMA nodes. The peak is the most objects the pool as a whole has
+    /// had out at once, not the sum of its allocators' peaks.
+    PoolStats stats() const
+    {
+        PoolStats s;
+        s.name = name_;
+        s.slotSize = slotSize<T>();
+        for (size_t i = 0; i < slots_.size(); ++i)
+        {
+            s += slots_[i]->stats();
+            s += nodes_[i]->stats();
+        }
+        s.peak = std::max(s.live, live_->peak());
+        return s;
     }
 
 protected:
 
-    void DestroyObject(T* ptr)
+    void DestroyObject(T* ptr, SlotAllocator* slots)
+    {
+        if(ptr != NULL)
+        {
+            ptr->~T();
+            slots->deallocate(ptr);
+        }
+    }
+
+private:
+    typedef boost::shared_ptr<SlotAllocator> AllocatorPtr;
+
+    void init()
     {
-        boost::lock_guard<boost::mutex> lock(mutex_);
-        if(ptr != NULL && pool_.is_from(ptr))
+        live_.reset(new SlotAllocator::LiveCount);
+        const size_t count = Numa::nodeCount();
+        for (size_t i = 0; i < count; ++i)
         {
-            pool_.destroy(ptr);
+            // a single node needs neither placement nor counting
+            const int node = count > 1 ? static_cast<int>(i) : -1;
+            slots_.push_back(AllocatorPtr(new SlotAllocator(slotSize<T>(), node, live_)));
+            nodes_.push_back(AllocatorPtr(new SlotAllocator(slotSize<PooledNode<T> >(), node, live_)));
         }
+        PoolRegistry::add(this, boost::bind(&CObjPool::stats, this));
+    }
+
+    /// sizeof(U) rounded up so that consecutive slots stay aligned
+    template <class U>
+    static size_t slotSize()
+    {
+        const size_t align = boost::alignment_of<U>::value > sizeof(void*)
+                             ? boost::alignment_of<U>::value : sizeof(void*);
+        return (sizeof(U) + align - 1) / align * align;
+    }
+
+    /// the allocators of the node the calling thread runs on
+    SlotAllocator& localSlots()
+    {
+        return *slots_[slots_.size() > 1 ? Numa::currentNode() : 0];
+    }
+
+    SlotAllocator& localNodes()
+    {
+        return *nodes_[nodes_.size() > 1 ? Numa::currentNode() : 0];
+    }
+
+    PooledNode<T>* allocateNode()
+    {
+        SlotAllocator& nodes = localNodes();
+        return new (nodes.allocate()) PooledNode<T>(&nodes);
+    }
+
+    void freeNode(PooledNode<T>* node)
+    {
+        SlotAllocator* slots = node->slots;
+        node->~PooledNode<T>();
+        slots->deallocate(node);
+    }
+
+    /// if the control block cannot be allocated, shared_ptr runs the
+    /// deleter itself
+    boost::shared_ptr<T> wrap(T* p, SlotAllocator* slots)
+    {
+        return boost::shared_ptr<T>(p,boost::bind(&CObjPool::DestroyObject,this,_1,slots) );
     }
 
 private:
-    boost::object_pool<T> pool_;
-    boost::mutex mutex_;
+    std::string name_;
+    /// one of each per NUMA node, indexed by node
+    std::vector<AllocatorPtr> slots_;
+    std::vector<AllocatorPtr> nodes_;
+    /// shared by every allocator above
+    boost::shared_ptr<SlotAllocator::LiveCount> live_;
 };
 }
 
@@ -0,0 +1,264 @@
+#include "ChainBuffer.h"
+#include <algorithm>
+
+namespace BaseLib
+{
+
+const size_t ChainBuffer::kCheapPrepend = 8;
+const size_t ChainBuffer::kDefaultSegmentSize = 16*1024;
+
+ChainBuffer::ChainBuffer(size_t segmentSize)
+    :   writeSeg_(0),
+        readable_(0),
+        segmentSize_(segmentSize),
+        spare_(NULL)
+{
+    assert(segmentSize_ > kCheapPrepend);
+    segments_.push_back(newSegment(kCheapPrepend));
+}
+
+ChainBuffer::~ChainBuffer()
+{
+    for (size_t i = 0; i < segments_.size(); ++i)
+    {
+        delete[] segments_[i].data;
+    }
+    delete[] spare_;
+}
+
+void ChainBuffer::swap(ChainBuffer& rhs)
+{
+    segments_.swap(rhs.segments_);
+    std::swap(writeSeg_, rhs.writeSeg_);
+    std::swap(readable_, rhs.readable_);
+    std::swap(segmentSize_, rhs.segmentSize_);
+    std::swap(spare_, rhs.spare_);
+}
+
+void ChainBuffer::retrieve(size_t len)
+{
+    assert(len <= readableBytes());
+    if (len == readableBytes())
+    {
+        retrieveAll();
+        return;
+    }
+    while (len > 0)
+    {
+        Segment& front = segments_.front();
+        size_t n = std::min(len, front.writerIndex - front.readerIndex);
+        front.readerIndex += n;
+        readable_ -= n;
+        len -= n;
+        if (front.readerIndex == front.writerIndex && writeSeg_ > 0)
+        {
+            releaseSegment(front);
+            segments_.pop_front();
+            --writeSeg_;
+        }
+    }
+}
+
+void ChainBuffer::retrieveAll()
+{
+    while (segments_.size() > 1)
+    {
+        releaseSegment(segments_.back());
+        segments_.pop_back();
+    }
+    segments_.front().readerIndex = kCheapPrepend;
+    segments_.front().writerIndex = kCheapPrepend;
+    writeSeg_ = 0;
+    readable_ = 0;
+}
+
+const char* ChainBuffer::peek() const
+{
+    const Segment& front = segments_.front();
+    return front.data + front.readerIndex;
+}
+
+size_t ChainBuffer::peekableBytes() const
+{
+    const Segment& front = segments_.front();
+    return front.writerIndex - front.readerIndex;
+}
+
+void ChainBuffer::peek(void* out, size_t len) const
+{
+    assert(len <= readableBytes());
+    char* dst = static_cast<char*>(out);
+    for (size_t i = 0; len > 0; ++i)
+    {
+        const Segment& seg = segments_[i];
+        size_t n = std::min(len, seg.writerIndex - seg.readerIndex);
+        memcpy(dst, seg.data + seg.readerIndex, n);
+        dst += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::append(const char* data, size_t len)
+{
+    while (len > 0)
+    {
+        Segment& seg = segments_[writeSeg_];
+        size_t n = std::min(len, segmentSize_ - seg.writerIndex);
+        if (n == 0)
+        {
+            ensureWritableBytes(len);
+            ++writeSeg_;
+            continue;
+        }
+        memcpy(seg.data + seg.writerIndex, data, n);
+        seg.writerIndex += n;
+        readable_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::append(const void* data, size_t len)
+{
+    append(static_cast<const char*>(data), len);
+}
+
+void ChainBuffer::append(const string& data)
+{
+    append(data.data(), data.length());
+}
+
+string ChainBuffer::readAllAsString()
+{
+    return readAsString(readableBytes());
+}
+
+string ChainBuffer::readAsString(size_t len)
+{
+    if (len > readableBytes())
+    {
+        len = readableBytes();
+    }
+    std::string result(len, '\0');
+    if (len > 0)
+    {
+        peek(&result[0], len);
+    }
+    retrieve(len);
+    return result;
+}
+
+void ChainBuffer::prepend(const void* data, size_t len)
+{
+    // fill the headroom of the front segment from the back of data,
+    // chaining a fresh segment in front whenever the headroom runs out
+    const char* d = static_cast<const char*>(data);
+    while (len > 0)
+    {
+        if (segments_.front().readerIndex == 0)
+        {
+            segments_.push_front(newSegment(segmentSize_));
+            ++writeSeg_;
+        }
+        Segment& front = segments_.front();
+        size_t n = std::min(len, front.readerIndex);
+        front.readerIndex -= n;
+        memcpy(front.data + front.readerIndex, d + len - n, n);
+        readable_ += n;
+        len -= n;
+    }
+}
+
+ChainBuffer::ConstBufferSequence ChainBuffer::constBuffers(size_t maxBytes) const
+{
+    ConstBufferSequence buffers;
+    for (size_t i = 0; i <= writeSeg_ && maxBytes > 0; ++i)
+    {
+        const Segment& seg = segments_[i];
+        size_t n = std::min(maxBytes, seg.writerIndex - seg.readerIndex);
+        if (n > 0)
+        {
+            buffers.push_back(boost::asio::const_buffer(seg.data + seg.readerIndex, n));
+            maxBytes -= n;
+        }
+    }
+    return buffers;
+}
+
+ChainBuffer::MutableBufferSequence ChainBuffer::prepareBuffers(size_t len)
+{
+    ensureWritableBytes(len);
+    MutableBufferSequence buffers;
+    for (size_t i = writeSeg_; i < segments_.size() && len > 0; ++i)
+    {
+        Segment& seg = segments_[i];
+        size_t n = std::min(len, segmentSize_ - seg.writerIndex);
+        if (n > 0)
+        {
+            buffers.push_back(boost::asio::mutable_buffer(seg.data + seg.writerIndex, n));
+            len -= n;
+        }
+    }
+    return buffers;
+}
+
+void ChainBuffer::commit(size_t len)
+{
+    while (len > 0)
+    {
+        Segment& seg = segments_[writeSeg_];
+        size_t n = std::min(len, segmentSize_ - seg.writerIndex);
+        if (n == 0)
+        {
+            assert(writeSeg_ + 1 < segments_.size());
+            ++writeSeg_;
+            continue;
+        }
+        seg.writerIndex += n;
+        readable_ += n;
+        len -= n;
+    }
+}
+
+ChainBuffer::Segment ChainBuffer::newSegment(size_t readerIndex)
+{
+    Segment seg;
+    if (spare_)
+    {
+        seg.data = spare_;
+        spare_ = NULL;
+    }
+    else
+    {
+        seg.data = new char[segmentSize_];
+    }
+    seg.readerIndex = readerIndex;
+    seg.writerIndex = readerIndex;
+    return seg;
+}
+
+void ChainBuffer::releaseSegment(Segment& seg)
+{
+    if (spare_ == NULL)
+    {
+        spare_ = seg.data;
+    }
+    else
+    {
+        delete[] seg.data;
+    }
+    seg.data = NULL;
+}
+
+void ChainBuffer::ensureWritableBytes(size_t len)
+{
+    size_t writable = segmentSize_ - segments_[writeSeg_].writerIndex;
+    writable += (segments_.size() - writeSeg_ - 1) * segmentSize_;
+    while (writable < len)
+    {
+        segments_.push_back(newSegment(0));
+        writable += segmentSize_;
+    }
+}
+
+}
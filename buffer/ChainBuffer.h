@@ -0,0 +1,239 @@
+#ifndef _CHAINBUFFER_H
+#define _CHAINBUFFER_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <string.h>
+#include <assert.h>
+#include "stdint.h"
+#include <boost/noncopyable.hpp>
+#include <boost/asio/buffer.hpp>
+#include "ByteOrder.h"
+using namespace std;
+
+/// A buffer made of fixed-size segments, with the same
+/// prepend/append/peek/retrieve interface as Buffer.
+///
+/// @code
+///  segment 0            segment 1            segment 2 (writeSeg_)
+/// +----+-------------+ +------------------+ +---------+--------+
+/// |    |  readable   | |     readable     | |readable |writable|
+/// +----+-------------+ +------------------+ +---------+--------+
+/// @endcode
+///
+/// Growing never moves bytes that are already stored: a new segment is
+/// chained on instead. constBuffers() and prepareBuffers() hand the
+/// segments to asio as buffer sequences, so async_write / async_read_some
+/// do scatter/gather I/O straight into and out of the chain.
+
+namespace BaseLib
+{
+
+class ChainBuffer : boost::noncopyable
+{
+public:
+    static const size_t kCheapPrepend;
+    static const size_t kDefaultSegmentSize;
+
+    typedef std::vector<boost::asio::const_buffer> ConstBufferSequence;
+    typedef std::vector<boost::asio::mutable_buffer> MutableBufferSequence;
+
+    explicit ChainBuffer(size_t segmentSize = kDefaultSegmentSize);
+    ~ChainBuffer();
+
+    void swap(ChainBuffer& rhs);
+
+    ///
+    /// retrieve
+    ///
+
+    void retrieve(size_t len);
+
+    void retrieveInt32()
+    {
+        retrieve(sizeof(int32_t));
+    }
+
+    void retrieveInt16()
+    {
+        retrieve(sizeof(int16_t));
+    }
+
+    void retrieveInt8()
+    {
+        retrieve(sizeof(int8_t));
+    }
+
+    void retrieveAll();
+
+    ///
+    /// get point and size
+    ///
+
+    /// first readable byte; only peekableBytes() of it are contiguous
+    const char* peek() const;
+
+    size_t peekableBytes() const;
+
+    size_t readableBytes() const
+    {
+        return readable_;
+    }
+
+    size_t segmentSize() const
+    {
+        return segmentSize_;
+    }
+
+    size_t segmentCount() const
+    {
+        return segments_.size();
+    }
+
+    ///
+    /// Append int using network endian
+    ///
+    void appendInt32(int32_t x)
+    {
+        int32_t be32 = sockets::hostToNetwork32(x);
+        append(&be32, sizeof be32);
+    }
+
+    void appendInt16(int16_t x)
+    {
+        int16_t be16 = sockets::hostToNetwork16(x);
+        append(&be16, sizeof be16);
+    }
+
+    void appendInt8(int8_t x)
+    {
+        append(&x, sizeof x);
+    }
+
+    void append(const char* /*restrict*/ data, size_t len);
+
+    void append(const void* /*restrict*/ data, size_t len);
+
+    void append(const string &data);
+
+    ///
+    /// Read
+    ///
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieveInt32();
+        return result;
+    }
+
+    int16_t readInt16()
+    {
+        int16_t result = peekInt16();
+        retrieveInt16();
+        return result;
+    }
+
+    int8_t readInt8()
+    {
+        int8_t result = peekInt8();
+        retrieveInt8();
+        return result;
+    }
+
+    string readAllAsString();
+
+    string readAsString(size_t len);
+
+    ///
+    /// Peek
+    ///
+
+    int32_t peekInt32() const
+    {
+        assert(readableBytes() >= sizeof(int32_t));
+        int32_t be32 = 0;
+        peek(&be32, sizeof be32);
+        return sockets::networkToHost32(be32);
+    }
+
+    int16_t peekInt16() const
+    {
+        assert(readableBytes() >= sizeof(int16_t));
+        int16_t be16 = 0;
+        peek(&be16, sizeof be16);
+        return sockets::networkToHost16(be16);
+    }
+
+    int8_t peekInt8() const
+    {
+        assert(readableBytes() >= sizeof(int8_t));
+        int8_t x = *peek();
+        return x;
+    }
+
+    /// copies the first len readable bytes out, across segment boundaries
+    void peek(void* out, size_t len) const;
+
+    ///
+    /// Prepend int using network endian
+    ///
+    void prependInt32(int32_t x)
+    {
+        int32_t be32 = sockets::hostToNetwork32(x);
+        prepend(&be32, sizeof be32);
+    }
+
+    void prependInt16(int16_t x)
+    {
+        int16_t be16 = sockets::hostToNetwork16(x);
+        prepend(&be16, sizeof be16);
+    }
+
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof x);
+    }
+
+    void prepend(const void* /*restrict*/ data, size_t len);
+
+    ///
+    /// Scatter/gather views for asio
+    ///
+
+    /// readable bytes, segment by segment, at most maxBytes in total;
+    /// the chain must not be modified until the write completes
+    ConstBufferSequence constBuffers(size_t maxBytes = static_cast<size_t>(-1)) const;
+
+    /// writable space of at least len bytes, chaining on segments as needed;
+    /// follow the read with commit(bytes_transferred)
+    MutableBufferSequence prepareBuffers(size_t len);
+
+    void commit(size_t len);
+
+private:
+    struct Segment
+    {
+        char*  data;
+        size_t readerIndex;
+        size_t writerIndex;
+    };
+
+    Segment newSegment(size_t readerIndex);
+
+    void releaseSegment(Segment& seg);
+
+    void ensureWritableBytes(size_t len);
+
+private:
+    std::deque<Segment> segments_;
+    /// index of the segment that receives the next appended byte
+    size_t writeSeg_;
+    size_t readable_;
+    size_t segmentSize_;
+    /// one drained segment kept back so a steady stream does not malloc
+    char* spare_;
+};
+
+}
+#endif  // _CHAINBUFFER_H
@@ -1,90 +1,426 @@
 #include "CircularBuffer.h"
-#include <cstdio> //for fopen
+#include "MappedFile.h"
+#include <string.h>
+#include <algorithm>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define BASELIB_HAVE_MEMFD 1
+#endif
 
 namespace BaseLib
 {
+
+namespace
+{
+
+#ifdef BASELIB_HAVE_MEMFD
+size_t pageRoundUp(size_t nSize)
+{
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return (nSize + page - 1) / page * page;
+}
+
+/// nSize bytes of a memfd mapped at p and again at p + nSize; NULL on failure
+char *mapMirror(size_t nSize)
+{
+    int fd = ::memfd_create("CircularBuffer", MFD_CLOEXEC);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    char *base = NULL;
+    if(::ftruncate(fd, nSize) == 0)
+    {
+        // reserve both halves first so nothing else can land in between
+        void *p = ::mmap(NULL, 2*nSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p != MAP_FAILED)
+        {
+            base = static_cast<char *>(p);
+            if(::mmap(base, nSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+               || ::mmap(base + nSize, nSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+            {
+                ::munmap(base, 2*nSize);
+                base = NULL;
+            }
+        }
+    }
+    // the mappings keep the memory alive
+    ::close(fd);
+    return base;
+}
+#endif
+
+}
+
+CircularBuffer::CircularBuffer(uint32_t nSize, bool bMirrored)
+    :data_(NULL),
+     mirrored_(false),
+     capacity_(0),
+     head_(0),
+     size_(0)
+{
+    reset(nSize, bMirrored);
+}
+
+CircularBuffer::~CircularBuffer(void)
+{
+    releaseBlock();
+}
+
+void CircularBuffer::releaseBlock()
+{
+#ifdef BASELIB_HAVE_MEMFD
+    if(mirrored_)
+    {
+        ::munmap(data_, 2*capacity_);
+        data_ = NULL;
+        return;
+    }
+#endif
+    delete[] data_;
+    data_ = NULL;
+}
+
+void CircularBuffer::reset(size_t nSize, bool bMirrored)
+{
+    head_ = 0;
+    size_ = 0;
+#ifdef BASELIB_HAVE_MEMFD
+    if(bMirrored && nSize > 0)
+    {
+        nSize = pageRoundUp(nSize);
+        if(mirrored_ && nSize == capacity_)
+        {
+            return;
+        }
+        char *data = mapMirror(nSize);
+        if(data)
+        {
+            releaseBlock();
+            data_ = data;
+            mirrored_ = true;
+            capacity_ = nSize;
+            return;
+        }
+    }
+#else
+    (void)bMirrored;
+#endif
+    if(mirrored_ || nSize != capacity_)
+    {
+        char *data = nSize > 0 ? new char[nSize] : NULL;
+        releaseBlock();
+        data_ = data;
+        mirrored_ = false;
+        capacity_ = nSize;
+    }
+}
+
+void CircularBuffer::copyOut(size_t pos, size_t len, char *dst) const
+{
+    assert(pos + len <= size_);
+    if(len == 0)
+    {
+        return;
+    }
+    size_t start = head_ + pos;
+    if(start >= capacity_)
+    {
+        start -= capacity_;
+    }
+    if(mirrored_)
+    {
+        ::memcpy(dst, data_ + start, len);
+        return;
+    }
+    size_t first = std::min(len, capacity_ - start);
+    ::memcpy(dst, data_ + start, first);
+    ::memcpy(dst + first, data_, len - first);
+}
+
+bool CircularBuffer::locate(uint32_t nLen, uint32_t nOffset, bool from_end, size_t &pos) const
+{
+    if(static_cast<size_t>(nOffset) + nLen > size_)
+    {
+        return false;
+    }
+    pos = from_end ? size_ - nOffset - nLen : nOffset;
+    return true;
+}
+
+const char *CircularBuffer::peek(uint32_t nLen, uint32_t nOffset, bool from_end) const
+{
+    size_t pos = 0;
+    if(!mirrored_ || !locate(nLen, nOffset, from_end, pos))
+    {
+        return NULL;
+    }
+    size_t start = head_ + pos;
+    if(start >= capacity_)
+    {
+        start -= capacity_;
+    }
+    return data_ + start;
+}
+
 void CircularBuffer::append(const char *data,size_t len)
 {
-    m_circular_buffer_.insert(m_circular_buffer_.end(),data,data+len);
+    if(capacity_ == 0 || len == 0)
+    {
+        return;
+    }
+    if(len >= capacity_)
+    {
+        // only the newest capacity_ bytes survive
+        ::memcpy(data_, data + len - capacity_, capacity_);
+        head_ = 0;
+        size_ = capacity_;
+        return;
+    }
+    size_t tail = head_ + size_;
+    if(tail >= capacity_)
+    {
+        tail -= capacity_;
+    }
+    if(mirrored_)
+    {
+        ::memcpy(data_ + tail, data, len);
+    }
+    else
+    {
+        size_t first = std::min(len, capacity_ - tail);
+        ::memcpy(data_ + tail, data, first);
+        ::memcpy(data_, data + first, len - first);
+    }
+    size_ += len;
+    if(size_ > capacity_)
+    {
+        head_ += size_ - capacity_;
+        if(head_ >= capacity_)
+        {
+            head_ -= capacity_;
+        }
+        size_ = capacity_;
+    }
 }
 void CircularBuffer::append(const std::string &sData)
 {
-    m_circular_buffer_.insert(m_circular_buffer_.end(),sData.begin(),sData.end());
+    append(sData.data(),sData.size());
 }
 void CircularBuffer::append(const CircularBuffer &data)
 {
-    m_circular_buffer_.insert(m_circular_buffer_.end(),data.m_circular_buffer_.begin(),
-                              data.m_circular_buffer_.end());
+    if(&data == this)
+    {
+        std::string copy = readAllAsString();
+        append(copy);
+        return;
+    }
+    if(data.mirrored_)
+    {
+        append(data.data_ + data.head_, data.size_);
+        return;
+    }
+    // the source's two segments, oldest first
+    size_t first = std::min(data.size_, data.capacity_ - data.head_);
+    append(data.data_ + data.head_, first);
+    append(data.data_, data.size_ - first);
 }
 void CircularBuffer::append(const Buffer& buffer)
 {
-    m_circular_buffer_.insert(m_circular_buffer_.end(),
-                              buffer.peek(),buffer.peek()+buffer.readableBytes());
+    append(buffer.peek(),buffer.readableBytes());
 }
 
-int32_t CircularBuffer::appendFromFile(const std::string path,const std::string mode)
+int32_t CircularBuffer::appendFromFile(const std::string path,const std::string)
 {
-    FILE *fp = fopen(path.c_str(),mode.c_str());
-    int32_t nLength = -1;
-    if (fp)
+    // mode is kept for compatibility; the file is always mapped read-only
+    // and copied into the ring straight from the page cache
+    MappedFile file(path);
+    if (!file.valid())
     {
-        fseek(fp,0,SEEK_END);
-        nLength = ftell(fp);
-        fseek(fp,0,SEEK_SET);
-        int8_t *pContent = new int8_t[nLength+1]();
-        fread(pContent,1,nLength,fp);
-        m_circular_buffer_.assign(&pContent[0],&pContent[nLength]);
-        delete[] pContent;
-        pContent = NULL;
+        return -1;
     }
-    fclose(fp);
-    return nLength;
+    file.adviseSequential();
+    reset(file.size(), mirrored_);
+    append(file.data(),file.size());
+    return static_cast<int32_t>(file.size());
 }
 
-std::string CircularBuffer::readAllAsString()
+int64_t CircularBuffer::appendTailFromFile(const std::string &path)
 {
-    std::string sRes("");
-    sRes.append(m_circular_buffer_.begin(),m_circular_buffer_.end());
-    return sRes;
+    uint64_t offset = 0;
+    return followFile(path, offset);
 }
-std::string CircularBuffer::readAsString(uint32_t nLen, uint32_t nOffset, bool from_end)
+
+#ifdef WIN32
+
+int64_t CircularBuffer::followFile(const std::string &path, uint64_t &offset)
 {
-    std::string sRes;
+    MappedFile file(path);
+    if(!file.valid())
+    {
+        return -1;
+    }
+    uint64_t from = tailStart(file.size(), offset);
+    size_t len = static_cast<size_t>(file.size() - from);
+    append(file.data() + from, len);
+    offset = file.size();
+    return static_cast<int64_t>(len);
+}
+
+#else
+
+namespace
+{
+
+/// reads until len bytes, EOF or an error; the count read, or -1
+ssize_t preadFully(int fd, char *dst, size_t len, off_t from)
+{
+    size_t done = 0;
+    while(done < len)
+    {
+        ssize_t n = ::pread(fd, dst + done, len - done, from + done);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n < 0)
+        {
+            return done > 0 ? static_cast<ssize_t>(done) : -1;
+        }
+        if(n == 0)
+        {
+            break;
+        }
+        done += n;
+    }
+    return static_cast<ssize_t>(done);
+}
+
+}
 
-    if(nOffset + nLen <= m_circular_buffer_.size() && nOffset >= 0)
+int64_t CircularBuffer::followFile(const std::string &path, uint64_t &offset)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if(::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    const uint64_t from = tailStart(fileSize, offset);
+    const size_t len = static_cast<size_t>(fileSize - from);
+    size_t got = 0;
+    if(len > 0)
     {
-        if(from_end)
+        // pread the surviving bytes straight into the ring, in the one
+        // or two pieces append() would have copied them to
+        size_t tail = head_ + size_;
+        if(tail >= capacity_)
+        {
+            tail -= capacity_;
+        }
+        size_t first = mirrored_ ? len : std::min(len, capacity_ - tail);
+        ssize_t n = preadFully(fd, data_ + tail, first, static_cast<off_t>(from));
+        if(n > 0)
+        {
+            got = n;
+        }
+        if(got == first && first < len)
         {
-            sRes.append(m_circular_buffer_.end()-nOffset-nLen,
-                        m_circular_buffer_.end()-nOffset);
+            n = preadFully(fd, data_, len - first, static_cast<off_t>(from + first));
+            if(n > 0)
+            {
+                got += n;
+            }
         }
-        else
+        size_ += got;
+        if(size_ > capacity_)
         {
-            sRes.append(m_circular_buffer_.begin()+nOffset,
-                        m_circular_buffer_.begin()+nOffset+nLen);
+            head_ += size_ - capacity_;
+            if(head_ >= capacity_)
+            {
+                head_ -= capacity_;
+            }
+            size_ = capacity_;
         }
     }
+    ::close(fd);
+    offset = from + got;
+    return static_cast<int64_t>(got);
+}
+
+#endif  // WIN32
+
+uint64_t CircularBuffer::tailStart(uint64_t fileSize, uint64_t offset) const
+{
+    if(offset > fileSize)
+    {
+        // truncated or replaced: start over like a fresh tail
+        offset = 0;
+    }
+    if(fileSize - offset > capacity_)
+    {
+        // only the last capacity_ bytes would survive anyway
+        offset = fileSize - capacity_;
+    }
+    return offset;
+}
+
+std::string CircularBuffer::readAllAsString()
+{
+    std::string sRes(size_, '\0');
+    if(size_ > 0)
+    {
+        copyOut(0, size_, &sRes[0]);
+    }
+    return sRes;
+}
+std::string CircularBuffer::readAsString(uint32_t nLen, uint32_t nOffset, bool from_end)
+{
+    std::string sRes;
+    size_t pos = 0;
+    if(locate(nLen, nOffset, from_end, pos) && nLen > 0)
+    {
+        sRes.resize(nLen);
+        copyOut(pos, nLen, &sRes[0]);
+    }
     return sRes;
 }
 
+void CircularBuffer::copyOut(size_t pos, size_t len, Buffer &out) const
+{
+    out.ensureWritableBytes(len);
+    copyOut(pos, len, out.beginWrite());
+    out.hasWritten(len);
+}
+
 Buffer CircularBuffer::readAllAsBuffer()
 {
     Buffer buffer;
-    std::string str = readAllAsString();
-    if(!str.empty())
-    {
-        buffer.append(str);
-    }
+    copyOut(0, size_, buffer);
     return buffer;
 }
 
 Buffer CircularBuffer::readAsBuffer(uint32_t nLen, uint32_t nOffset, bool from_end)
 {
     Buffer buffer;
-    std::string str = readAsString(nLen,nOffset,from_end);
-    if(!str.empty())
+    size_t pos = 0;
+    if(locate(nLen, nOffset, from_end, pos))
     {
-        buffer.append(str);
+        copyOut(pos, nLen, buffer);
     }
     return buffer;
 }
@@ -92,23 +428,56 @@ Buffer CircularBuffer::readAsBuffer(uint32_t nLen, uint32_t nOffset, bool from_e
 bool CircularBuffer::readAsBuffer(Buffer &out,uint32_t nLen, uint32_t nOffset, bool from_end)
 {
 	out.retrieveAll();
-	std::string str = readAsString(nLen,nOffset,from_end);
-	if(!str.empty())
+	size_t pos = 0;
+	if(locate(nLen, nOffset, from_end, pos))
 	{
-		out.append(str);
+		copyOut(pos, nLen, out);
 	}
 	return true;
 }
 
+bool CircularBuffer::view(Segments &out, uint32_t nLen, uint32_t nOffset, bool from_end) const
+{
+    size_t pos = 0;
+    if(!locate(nLen, nOffset, from_end, pos))
+    {
+        return false;
+    }
+    size_t start = head_ + pos;
+    if(start >= capacity_)
+    {
+        start -= capacity_;
+    }
+    out.first = data_ + start;
+    out.firstLen = nLen;
+    out.second = NULL;
+    out.secondLen = 0;
+    if(!mirrored_ && start + nLen > capacity_)
+    {
+        out.firstLen = capacity_ - start;
+        out.second = data_;
+        out.secondLen = nLen - out.firstLen;
+    }
+    return true;
+}
+
 CircularBuffer::CircularBuffer(CircularBuffer &rhs)
+    :data_(NULL),
+     mirrored_(false),
+     capacity_(0),
+     head_(0),
+     size_(0)
 {
-    m_circular_buffer_ = rhs.m_circular_buffer_;
+    *this = rhs;
 }
 
 CircularBuffer& CircularBuffer::operator = (const CircularBuffer &rhs)
 {
-    m_circular_buffer_ = rhs.m_circular_buffer_;
+    if(&rhs != this)
+    {
+        reset(rhs.capacity_, rhs.mirrored_);
+        append(rhs);
+    }
     return *this;
 }
 }
-
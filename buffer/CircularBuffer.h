@@ -2,11 +2,30 @@
 #define __CIRCULARBUFFERF_H__
 
 #include <string>
-#include <boost/circular_buffer.hpp>
 #include "buffer/Buffer.h"
 
 #define  CIRCUALR_BUFFER_SIZE 1024*1024*1 //2MB
 
+/// A fixed-capacity byte ring that keeps the newest bytes: appending to a
+/// full ring overwrites the oldest ones.
+///
+/// @code
+/// +-----------+----------------------+----------------+
+/// |  newest   |       (free)         |     oldest     |
+/// +-----------+----------------------+----------------+
+/// 0      head_+size_-capacity_     head_          capacity_
+/// @endcode
+///
+/// The bytes are kept in one flat block, so every append and read is at
+/// most two memcpys, one on each side of the wrap point.
+///
+/// In mirrored mode the block is a memfd mapped twice, back to back, so
+/// data_[i] and data_[i + capacity_] are the same byte. A span that wraps
+/// is then still one pointer range, and peek() hands it out for scanning
+/// or write() with no copy at all. Mirrored rings round their capacity up
+/// to whole pages; where the double mapping is not available (no memfd,
+/// WIN32) the ring silently stays a plain one and mirrored() says so.
+
 namespace BaseLib
 {
 	class CircularBuffer
@@ -18,6 +37,18 @@ namespace BaseLib
 		void append(const Buffer &buffer);
 
 		int32_t appendFromFile(const std::string path,const std::string mode = "rb");
+
+		/// Appends the file's last capacity() bytes, reading nothing before
+		/// them. Unlike appendFromFile() the capacity is kept. Returns the
+		/// bytes appended, or -1 if the file cannot be opened.
+		int64_t appendTailFromFile(const std::string &path);
+
+		/// tail -f: appends what was added to the file since offset (only
+		/// the last capacity() bytes of it) and moves offset to the end of
+		/// what was read. Start with offset 0; a file that shrank below
+		/// offset is read again from the start. Returns the bytes appended,
+		/// or -1 if the file cannot be opened.
+		int64_t followFile(const std::string &path, uint64_t &offset);
 		std::string readAllAsString();
 		std::string readAsString(uint32_t nLen,uint32_t nOffset = 0,bool from_end = true);
 
@@ -29,25 +60,69 @@ namespace BaseLib
 		CircularBuffer& operator = (const CircularBuffer &rhs);
 
 	public:
-		CircularBuffer(uint32_t nSize = CIRCUALR_BUFFER_SIZE)
-			:m_circular_buffer_(nSize)
-		  {
-		  }
-		~CircularBuffer(void)
+		CircularBuffer(uint32_t nSize = CIRCUALR_BUFFER_SIZE, bool bMirrored = false);
+		~CircularBuffer(void);
+
+		bool mirrored() const
+		{
+			return mirrored_;
+		}
+
+		/// The one or two raw pieces of a span, oldest first; second is
+		/// NULL unless the span wraps (never in mirrored mode).
+		struct Segments
 		{
+			const char *first;
+			size_t firstLen;
+			const char *second;
+			size_t secondLen;
+		};
 
+		/// The nLen bytes selected as in readAsString(), in place. false if
+		/// out of range. Valid until the next append.
+		bool view(Segments &out,uint32_t nLen,uint32_t nOffset = 0,bool from_end = true) const;
+
+		/// Mirrored mode only: the nLen bytes selected as in readAsString(),
+		/// in place. NULL if out of range or the ring is not mirrored.
+		/// Valid until the next append.
+		const char *peek(uint32_t nLen,uint32_t nOffset = 0,bool from_end = true) const;
+
+		size_t size() const
+		{
+			return size_;
 		}
-		size_t size()
+
+		size_t capacity() const
 		{
-			return m_circular_buffer_.size();
+			return capacity_;
 		}
 
 		void clear()
 		{
-			m_circular_buffer_.clear();
+			head_ = 0;
+			size_ = 0;
 		}
 	private:
-		boost::circular_buffer<char> m_circular_buffer_;
+		/// copies len bytes starting pos bytes after the oldest one
+		void copyOut(size_t pos, size_t len, char *dst) const;
+		/// appends them to out, sized up front
+		void copyOut(size_t pos, size_t len, Buffer &out) const;
+		/// start of the span readAsString() selects, relative to the oldest
+		/// byte; false if the span is out of range
+		bool locate(uint32_t nLen, uint32_t nOffset, bool from_end, size_t &pos) const;
+		/// drops the contents and switches to a block of nSize bytes
+		void reset(size_t nSize, bool bMirrored);
+		void releaseBlock();
+		/// where a read of the file from offset has to start
+		uint64_t tailStart(uint64_t fileSize, uint64_t offset) const;
+
+	private:
+		char *data_;
+		bool mirrored_;
+		size_t capacity_;
+		/// index of the oldest byte
+		size_t head_;
+		size_t size_;
 	};
 
 }
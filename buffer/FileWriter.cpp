@@ -0,0 +1,209 @@
+#include "FileWriter.h"
+#include "MappedFile.h"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef WIN32
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define BASELIB_HAVE_COPY_FILE_RANGE 1
+#endif
+
+namespace BaseLib
+{
+
+const size_t FileWriter::kBlockSize;
+
+namespace
+{
+
+const size_t kStageAlignment = 4096;
+
+char* allocateStage()
+{
+#ifdef WIN32
+    return static_cast<char*>(_aligned_malloc(FileWriter::kBlockSize, kStageAlignment));
+#else
+    void* p = NULL;
+    if (::posix_memalign(&p, kStageAlignment, FileWriter::kBlockSize) != 0)
+    {
+        return NULL;
+    }
+    return static_cast<char*>(p);
+#endif
+}
+
+void freeStage(char* p)
+{
+#ifdef WIN32
+    _aligned_free(p);
+#else
+    ::free(p);
+#endif
+}
+
+}
+
+FileWriter::FileWriter(const std::string& path, bool append)
+    :   stage_(allocateStage()),
+        pending_(0),
+        written_(0),
+        ok_(stage_ != NULL)
+{
+#ifdef WIN32
+    file_ = fopen(path.c_str(), append ? "ab" : "wb");
+    ok_ = ok_ && file_ != NULL;
+#else
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    ok_ = ok_ && fd_ >= 0;
+#endif
+}
+
+FileWriter::~FileWriter()
+{
+    close();
+    freeStage(stage_);
+}
+
+void FileWriter::append(const char* data, size_t len)
+{
+    while (len > 0 && ok_)
+    {
+        if (pending_ == 0 && len >= kBlockSize)
+        {
+            size_t n = len - len % kBlockSize;
+            writeFully(data, n);
+            if (!ok_)
+            {
+                return;
+            }
+            written_ += n;
+            data += n;
+            len -= n;
+            continue;
+        }
+        size_t n = std::min(len, kBlockSize - pending_);
+        memcpy(stage_ + pending_, data, n);
+        pending_ += n;
+        written_ += n;
+        data += n;
+        len -= n;
+        if (pending_ == kBlockSize)
+        {
+            flush();
+        }
+    }
+}
+
+void FileWriter::appendFile(const std::string& path)
+{
+    flush();
+    if (!ok_)
+    {
+        return;
+    }
+    size_t copied = 0;
+#ifdef BASELIB_HAVE_COPY_FILE_RANGE
+    int in = ::open(path.c_str(), O_RDONLY);
+    if (in < 0)
+    {
+        ok_ = false;
+        return;
+    }
+    ssize_t n = 0;
+    do
+    {
+        n = ::copy_file_range(in, NULL, fd_, NULL, 1 << 30, 0);
+        if (n > 0)
+        {
+            copied += n;
+        }
+    } while (n > 0 || (n < 0 && errno == EINTR));
+    int err = errno;
+    ::close(in);
+    written_ += copied;
+    if (n == 0)
+    {
+        return;
+    }
+    // refused for O_APPEND targets and some file system pairs: stream
+    // the rest through a mapping instead
+    if (err != EBADF && err != EXDEV && err != EINVAL && err != ENOSYS && err != EOPNOTSUPP)
+    {
+        ok_ = false;
+        return;
+    }
+#endif
+    MappedFile file(path);
+    if (!file.valid())
+    {
+        ok_ = false;
+        return;
+    }
+    if (copied < file.size())
+    {
+        file.adviseSequential();
+        append(file.data() + copied, file.size() - copied);
+        flush();
+    }
+}
+
+void FileWriter::flush()
+{
+    if (pending_ > 0 && ok_)
+    {
+        writeFully(stage_, pending_);
+    }
+    pending_ = 0;
+}
+
+void FileWriter::close()
+{
+    flush();
+#ifdef WIN32
+    if (file_)
+    {
+        fclose(file_);
+        file_ = NULL;
+    }
+#else
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+void FileWriter::writeFully(const char* data, size_t len)
+{
+#ifdef WIN32
+    ok_ = fwrite(data, 1, len, file_) == len;
+#else
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd_, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ok_ = false;
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+#endif
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef _FILEWRITER_H
+#define _FILEWRITER_H
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#ifdef WIN32
+#include <stdio.h>
+#endif
+
+/// A streaming file writer that only issues large, block-aligned writes.
+///
+/// Small appends are staged in a page-aligned block and written out a
+/// whole block at a time; appends of a block or more bypass the staging
+/// block entirely. appendFile() copies another file in kernel space with
+/// copy_file_range() where the platform has it.
+
+namespace BaseLib
+{
+
+class FileWriter : boost::noncopyable
+{
+public:
+    static const size_t kBlockSize = 1024*1024;
+
+    /// truncates the file unless append is set
+    FileWriter(const std::string& path, bool append);
+    ~FileWriter();
+
+    /// false once opening or any write has failed
+    bool ok() const
+    {
+        return ok_;
+    }
+
+    /// bytes written or staged so far; nothing offered after a failed
+    /// write is counted
+    size_t writtenBytes() const
+    {
+        return written_;
+    }
+
+    void append(const char* data, size_t len);
+
+    /// appends the whole content of the file at path
+    void appendFile(const std::string& path);
+
+    void flush();
+
+    void close();
+
+private:
+    void writeFully(const char* data, size_t len);
+
+private:
+#ifdef WIN32
+    FILE* file_;
+#else
+    int fd_;
+#endif
+    char* stage_;
+    size_t pending_;
+    size_t written_;
+    bool ok_;
+};
+
+}
+#endif  // _FILEWRITER_H
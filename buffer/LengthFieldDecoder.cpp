@@ -0,0 +1,95 @@
+#include "LengthFieldDecoder.h"
+#include <assert.h>
+
+namespace BaseLib
+{
+
+LengthFieldDecoder::LengthFieldDecoder(size_t maxFrameLength,
+                                       size_t lengthFieldOffset,
+                                       size_t lengthFieldLength,
+                                       int64_t lengthAdjustment,
+                                       size_t initialBytesToStrip,
+                                       ByteOrder byteOrder)
+    :   maxFrameLength_(maxFrameLength),
+        lengthFieldOffset_(lengthFieldOffset),
+        lengthFieldLength_(lengthFieldLength),
+        lengthFieldEnd_(lengthFieldOffset + lengthFieldLength),
+        lengthAdjustment_(lengthAdjustment),
+        initialBytesToStrip_(initialBytesToStrip),
+        byteOrder_(byteOrder),
+        error_(kNoError)
+{
+    assert(lengthFieldLength == 1 || lengthFieldLength == 2 || lengthFieldLength == 3
+           || lengthFieldLength == 4 || lengthFieldLength == 8);
+}
+
+uint64_t LengthFieldDecoder::readLengthField(const char* p) const
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    uint64_t value = 0;
+    if (byteOrder_ == kBigEndian)
+    {
+        for (size_t i = 0; i < lengthFieldLength_; ++i)
+        {
+            value = (value << 8) | b[i];
+        }
+    }
+    else
+    {
+        for (size_t i = lengthFieldLength_; i > 0; --i)
+        {
+            value = (value << 8) | b[i-1];
+        }
+    }
+    return value;
+}
+
+bool LengthFieldDecoder::decode(Buffer& buf, std::vector<BufferSlice>& frames)
+{
+    error_ = kNoError;
+    spans_.clear();
+    const char* base = buf.peek();
+    const size_t readable = buf.readableBytes();
+    size_t offset = 0;
+    while (readable - offset >= lengthFieldEnd_)
+    {
+        uint64_t value = readLengthField(base + offset + lengthFieldOffset_);
+        if (value > maxFrameLength_)
+        {
+            error_ = kFrameTooLong;
+            break;
+        }
+        int64_t frameLength = static_cast<int64_t>(lengthFieldEnd_ + value) + lengthAdjustment_;
+        if (frameLength < static_cast<int64_t>(lengthFieldEnd_)
+            || frameLength < static_cast<int64_t>(initialBytesToStrip_))
+        {
+            error_ = kBadLength;
+            break;
+        }
+        if (static_cast<uint64_t>(frameLength) > maxFrameLength_)
+        {
+            error_ = kFrameTooLong;
+            break;
+        }
+        if (readable - offset < static_cast<size_t>(frameLength))
+        {
+            break;
+        }
+        spans_.push_back(std::make_pair(offset + initialBytesToStrip_,
+                                        static_cast<size_t>(frameLength) - initialBytesToStrip_));
+        offset += static_cast<size_t>(frameLength);
+    }
+
+    if (offset > 0)
+    {
+        BufferSlice block = buf.readAsSlice(offset);
+        frames.reserve(frames.size() + spans_.size());
+        for (size_t i = 0; i < spans_.size(); ++i)
+        {
+            frames.push_back(block.slice(spans_[i].first, spans_[i].second));
+        }
+    }
+    return error_ == kNoError;
+}
+
+}
@@ -0,0 +1,99 @@
+#ifndef _LENGTHFIELDDECODER_H
+#define _LENGTHFIELDDECODER_H
+
+#include <vector>
+#include "stdint.h"
+#include "Buffer.h"
+#include "BufferSlice.h"
+
+/// Splits a Buffer into frames that carry their own length, modeled after
+/// org.jboss.netty.handler.codec.frame.LengthFieldBasedFrameDecoder.
+///
+/// @code
+/// +--------+--------------+-----------------------------+
+/// | header | length field |  length + adjustment bytes  |
+/// +--------+--------------+-----------------------------+
+/// |<-lengthFieldOffset -->|
+/// @endcode
+///
+/// decode() takes every complete frame the Buffer holds in one go: they
+/// are detached together with a single readAsSlice() and handed out as
+/// BufferSlice views of that block, so a read event that brought in many
+/// small frames costs one detach and no per-frame copies. Typical use in
+/// a MessageCallBack:
+///
+/// @code
+/// frames.clear();
+/// if (!decoder.decode(buf, frames))
+/// {
+///     conn->Stop();
+///     return false;
+/// }
+/// for (size_t i = 0; i < frames.size(); ++i) handle(frames[i]);
+/// return true;
+/// @endcode
+
+namespace BaseLib
+{
+
+class LengthFieldDecoder
+{
+public:
+    enum ByteOrder
+    {
+        kBigEndian,
+        kLittleEndian
+    };
+
+    enum Error
+    {
+        kNoError,
+        kFrameTooLong,      ///< the length field exceeds maxFrameLength
+        kBadLength          ///< the adjusted length is negative or shorter than the stripped bytes
+    };
+
+    /// lengthFieldLength is 1, 2, 3, 4 or 8. The frame spans
+    /// lengthFieldOffset + lengthFieldLength + value + lengthAdjustment
+    /// bytes, of which the first initialBytesToStrip are dropped from the
+    /// delivered view. maxFrameLength bounds that whole span.
+    LengthFieldDecoder(size_t maxFrameLength,
+                       size_t lengthFieldOffset,
+                       size_t lengthFieldLength,
+                       int64_t lengthAdjustment = 0,
+                       size_t initialBytesToStrip = 0,
+                       ByteOrder byteOrder = kBigEndian);
+
+    /// Appends all complete frames in buf to frames and consumes them;
+    /// a trailing partial frame is left in buf. Returns false on a
+    /// malformed length, after delivering the frames in front of it; the
+    /// stream cannot be resynchronized and the connection should go.
+    bool decode(Buffer& buf, std::vector<BufferSlice>& frames);
+
+    Error lastError() const
+    {
+        return error_;
+    }
+
+    size_t maxFrameLength() const
+    {
+        return maxFrameLength_;
+    }
+
+private:
+    uint64_t readLengthField(const char* p) const;
+
+private:
+    size_t maxFrameLength_;
+    size_t lengthFieldOffset_;
+    size_t lengthFieldLength_;
+    size_t lengthFieldEnd_;
+    int64_t lengthAdjustment_;
+    size_t initialBytesToStrip_;
+    ByteOrder byteOrder_;
+    Error error_;
+    /// (offset, length) of each frame found in the current pass
+    std::vector<std::pair<size_t, size_t> > spans_;
+};
+
+}
+#endif  // _LENGTHFIELDDECODER_H
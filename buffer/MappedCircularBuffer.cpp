@@ -0,0 +1,271 @@
+#include "MappedCircularBuffer.h"
+#include "MappedFile.h"
+#include "FileWriter.h"
+#include <string.h>
+#include <algorithm>
+#include <boost/atomic.hpp>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace BaseLib
+{
+
+const size_t MappedCircularBuffer::kHeaderSize;
+
+namespace
+{
+
+const char kMagic[8] = { 'B', 'L', 'R', 'I', 'N', 'G', '0', '1' };
+
+/// keeps the compiler from moving header stores across the data copy;
+/// the process itself is the only writer, so no CPU fence is needed
+inline void storeOrder()
+{
+    boost::atomic_signal_fence(boost::memory_order_seq_cst);
+}
+
+}
+
+struct MappedCircularBuffer::Header
+{
+    char magic[8];
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t tail;
+};
+
+namespace
+{
+
+/// a header that can be trusted for a ring of capacity bytes
+bool consistent(const char* magic, uint64_t capacity, uint64_t head, uint64_t tail, uint64_t expected)
+{
+    return ::memcmp(magic, kMagic, sizeof kMagic) == 0
+           && capacity == expected
+           && head <= tail
+           && tail - head <= capacity;
+}
+
+}
+
+#ifdef WIN32
+
+MappedCircularBuffer::MappedCircularBuffer(const std::string& path, size_t capacity)
+    :   header_(NULL),
+        data_(NULL),
+        capacity_(capacity),
+        file_(INVALID_HANDLE_VALUE),
+        mapping_(NULL)
+{
+    const uint64_t total = kHeaderSize + static_cast<uint64_t>(capacity);
+    file_ = ::CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                          OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file_, &size))
+    {
+        return;
+    }
+    const bool fresh = static_cast<uint64_t>(size.QuadPart) != total;
+    mapping_ = ::CreateFileMappingA(file_, NULL, PAGE_READWRITE,
+                                    static_cast<DWORD>(total >> 32), static_cast<DWORD>(total), NULL);
+    if (mapping_ == NULL)
+    {
+        return;
+    }
+    void* p = ::MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0);
+    if (p == NULL)
+    {
+        return;
+    }
+    header_ = static_cast<Header*>(p);
+    data_ = static_cast<char*>(p) + kHeaderSize;
+    if (fresh || !consistent(header_->magic, header_->capacity, header_->head, header_->tail, capacity_))
+    {
+        ::memcpy(header_->magic, kMagic, sizeof kMagic);
+        header_->capacity = capacity_;
+        clear();
+    }
+}
+
+MappedCircularBuffer::~MappedCircularBuffer()
+{
+    if (header_)
+    {
+        ::UnmapViewOfFile(header_);
+    }
+    if (mapping_)
+    {
+        ::CloseHandle(mapping_);
+    }
+    if (file_ != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(file_);
+    }
+}
+
+bool MappedCircularBuffer::sync()
+{
+    return header_ != NULL && ::FlushViewOfFile(header_, 0) && ::FlushFileBuffers(file_);
+}
+
+#else
+
+MappedCircularBuffer::MappedCircularBuffer(const std::string& path, size_t capacity)
+    :   header_(NULL),
+        data_(NULL),
+        capacity_(capacity)
+{
+    const size_t total = kHeaderSize + capacity;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat st;
+    bool fresh = true;
+    if (::fstat(fd, &st) == 0)
+    {
+        fresh = static_cast<size_t>(st.st_size) != total;
+        if (!fresh || ::ftruncate(fd, total) == 0)
+        {
+            void* p = ::mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                header_ = static_cast<Header*>(p);
+                data_ = static_cast<char*>(p) + kHeaderSize;
+            }
+        }
+    }
+    ::close(fd);
+    if (header_ && (fresh || !consistent(header_->magic, header_->capacity, header_->head, header_->tail, capacity_)))
+    {
+        ::memcpy(header_->magic, kMagic, sizeof kMagic);
+        header_->capacity = capacity_;
+        clear();
+    }
+}
+
+MappedCircularBuffer::~MappedCircularBuffer()
+{
+    if (header_)
+    {
+        ::munmap(header_, kHeaderSize + capacity_);
+    }
+}
+
+bool MappedCircularBuffer::sync()
+{
+    return header_ != NULL && ::msync(header_, kHeaderSize + capacity_, MS_SYNC) == 0;
+}
+
+#endif  // WIN32
+
+size_t MappedCircularBuffer::size() const
+{
+    return header_ ? static_cast<size_t>(header_->tail - header_->head) : 0;
+}
+
+void MappedCircularBuffer::clear()
+{
+    if (header_)
+    {
+        header_->head = 0;
+        header_->tail = 0;
+    }
+}
+
+void MappedCircularBuffer::append(const char* data, size_t len)
+{
+    if (header_ == NULL || capacity_ == 0 || len == 0)
+    {
+        return;
+    }
+    if (len > capacity_)
+    {
+        data += len - capacity_;
+        len = capacity_;
+    }
+    const uint64_t tail = header_->tail;
+    const uint64_t end = tail + len;
+    if (end - header_->head > capacity_)
+    {
+        // give up the bytes about to be overwritten first
+        header_->head = end - capacity_;
+        storeOrder();
+    }
+    const size_t offset = static_cast<size_t>(tail % capacity_);
+    const size_t first = std::min(len, capacity_ - offset);
+    ::memcpy(data_ + offset, data, first);
+    ::memcpy(data_, data + first, len - first);
+    storeOrder();
+    header_->tail = end;
+}
+
+void MappedCircularBuffer::copyOut(uint64_t from, size_t len, char* dst) const
+{
+    const size_t offset = static_cast<size_t>(from % capacity_);
+    const size_t first = std::min(len, capacity_ - offset);
+    ::memcpy(dst, data_ + offset, first);
+    ::memcpy(dst + first, data_, len - first);
+}
+
+std::string MappedCircularBuffer::readAllAsString() const
+{
+    std::string sRes(size(), '\0');
+    if (!sRes.empty())
+    {
+        copyOut(header_->head, sRes.size(), &sRes[0]);
+    }
+    return sRes;
+}
+
+std::string MappedCircularBuffer::readAsString(uint32_t nLen, uint32_t nOffset, bool from_end) const
+{
+    std::string sRes;
+    const size_t held = size();
+    if (static_cast<size_t>(nOffset) + nLen <= held && nLen > 0)
+    {
+        sRes.resize(nLen);
+        uint64_t from = header_->head + (from_end ? held - nOffset - nLen : nOffset);
+        copyOut(from, nLen, &sRes[0]);
+    }
+    return sRes;
+}
+
+int64_t MappedCircularBuffer::dump(const std::string& ringPath, const std::string& outPath)
+{
+    MappedFile file(ringPath);
+    if (!file.valid() || file.size() < kHeaderSize)
+    {
+        return -1;
+    }
+    Header header;
+    ::memcpy(&header, file.data(), sizeof header);
+    const uint64_t capacity = file.size() - kHeaderSize;
+    if (!consistent(header.magic, header.capacity, header.head, header.tail, capacity))
+    {
+        return -1;
+    }
+    const char* data = file.data() + kHeaderSize;
+    const size_t len = static_cast<size_t>(header.tail - header.head);
+    const size_t offset = len > 0 ? static_cast<size_t>(header.head % capacity) : 0;
+    const size_t first = std::min(len, static_cast<size_t>(capacity) - offset);
+    FileWriter writer(outPath, false);
+    writer.append(data + offset, first);
+    writer.append(data, len - first);
+    writer.close();
+    return writer.ok() ? static_cast<int64_t>(len) : -1;
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef _MAPPEDCIRCULARBUFFER_H
+#define _MAPPEDCIRCULARBUFFER_H
+
+#include <string>
+#include "stdint.h"
+#include <boost/noncopyable.hpp>
+
+/// A CircularBuffer whose bytes live in a shared file mapping, for use as
+/// a flight recorder: the last capacity() bytes survive a crash of the
+/// process and can be read back afterwards.
+///
+/// @code
+/// +---------------------------------+------------------------------+
+/// | header (magic, capacity,        |   ring, capacity() bytes     |
+/// |         head, tail), one page   |                              |
+/// +---------------------------------+------------------------------+
+/// @endcode
+///
+/// head and tail count every byte ever appended, so the ring holds
+/// [head, tail) at offsets taken modulo the capacity. append() is plain
+/// memcpys into the mapping plus two header stores, no syscalls; the page
+/// cache keeps the data when the process dies. head is moved past the
+/// bytes about to be overwritten before they are, and tail only after
+/// they are written, so a crash in the middle of an append loses that
+/// append and nothing else. Reopening a file of the right size only
+/// checks the header, whatever the capacity. sync() is only needed to
+/// survive a crash of the machine.
+
+namespace BaseLib
+{
+
+class MappedCircularBuffer : boost::noncopyable
+{
+public:
+    static const size_t kHeaderSize = 4096;
+
+    /// Opens the recorder at path, keeping what it holds if it was made
+    /// with the same capacity, or creates it empty.
+    MappedCircularBuffer(const std::string& path, size_t capacity);
+    ~MappedCircularBuffer();
+
+    /// false if the file could not be opened or mapped
+    bool valid() const
+    {
+        return header_ != NULL;
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    size_t size() const;
+
+    void append(const char* data, size_t len);
+
+    void append(const std::string& data)
+    {
+        append(data.data(), data.size());
+    }
+
+    std::string readAllAsString() const;
+
+    /// same selection as CircularBuffer::readAsString()
+    std::string readAsString(uint32_t nLen, uint32_t nOffset = 0, bool from_end = true) const;
+
+    void clear();
+
+    /// flushes the mapping to disk
+    bool sync();
+
+    /// Offline dump: writes the bytes held by the recorder file at
+    /// ringPath, oldest first, to outPath without opening it for writing.
+    /// Returns the number of bytes written, or -1.
+    static int64_t dump(const std::string& ringPath, const std::string& outPath);
+
+private:
+    struct Header;
+
+    void copyOut(uint64_t from, size_t len, char* dst) const;
+
+private:
+    Header* header_;
+    char* data_;
+    size_t capacity_;
+#ifdef WIN32
+    void* file_;
+    void* mapping_;
+#endif
+};
+
+}
+#endif  // _MAPPEDCIRCULARBUFFER_H
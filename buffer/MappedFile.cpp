@@ -0,0 +1,142 @@
+#include "MappedFile.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace BaseLib
+{
+
+#ifdef WIN32
+
+MappedFile::MappedFile(const std::string& path)
+    :   data_(NULL),
+        size_(0),
+        valid_(false),
+        file_(INVALID_HANDLE_VALUE),
+        mapping_(NULL)
+{
+    file_ = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                          OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file_, &size))
+    {
+        return;
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0)
+    {
+        valid_ = true;
+        return;
+    }
+    mapping_ = ::CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL)
+    {
+        size_ = 0;
+        return;
+    }
+    data_ = static_cast<const char*>(::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == NULL)
+    {
+        size_ = 0;
+        return;
+    }
+    valid_ = true;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+    {
+        ::UnmapViewOfFile(data_);
+    }
+    if (mapping_)
+    {
+        ::CloseHandle(mapping_);
+    }
+    if (file_ != INVALID_HANDLE_VALUE)
+    {
+        ::CloseHandle(file_);
+    }
+}
+
+void MappedFile::adviseSequential()
+{
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+    :   data_(NULL),
+        size_(0),
+        valid_(false)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0)
+    {
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0)
+        {
+            valid_ = true;
+        }
+        else
+        {
+            // the mapping keeps its own reference to the file
+            void* p = ::mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data_ = static_cast<const char*>(p);
+                valid_ = true;
+            }
+            else
+            {
+                size_ = 0;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+    {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+void MappedFile::adviseSequential()
+{
+    if (data_)
+    {
+        ::madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+    }
+}
+
+#endif  // WIN32
+
+BufferSlice mapFile(const std::string& path)
+{
+    MappedFilePtr file(new MappedFile(path));
+    if (!file->valid() || file->size() == 0)
+    {
+        return BufferSlice();
+    }
+    return BufferSlice(file, file->data(), file->size());
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "BufferSlice.h"
+
+/// A whole file mapped read-only into memory.
+///
+/// mapFile() wraps the mapping in a BufferSlice, so a multi-GB file can be
+/// parsed, sliced and sent without ever being copied onto the heap; the
+/// mapping goes away with the last slice that refers to it.
+
+namespace BaseLib
+{
+
+class MappedFile : boost::noncopyable
+{
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    /// false if the file could not be opened or mapped
+    bool valid() const
+    {
+        return valid_;
+    }
+
+    const char* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /// hint the kernel that the mapping will be read front to back
+    void adviseSequential();
+
+private:
+    const char* data_;
+    size_t size_;
+    bool valid_;
+#ifdef WIN32
+    void* file_;
+    void* mapping_;
+#endif
+};
+
+typedef boost::shared_ptr<MappedFile> MappedFilePtr;
+
+/// The file's bytes as a read-only slice; empty if the file cannot be
+/// opened or mapped.
+BufferSlice mapFile(const std::string& path);
+
+}
+#endif  // _MAPPEDFILE_H
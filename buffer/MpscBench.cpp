@@ -0,0 +1,195 @@
+// 32 producers appending small records to one consumer, through the
+// lock-free MpscCircularBuffer and through a CircularBuffer behind a
+// boost::mutex, the way the log and stats sinks shared one before.
+//
+//   g++ -O2 -I.. MpscBench.cpp MpscCircularBuffer.cpp CircularBuffer.cpp Buffer.cpp
+//       BufferPool.cpp BufferSlice.cpp SizeClassAllocator.cpp Numa.cpp ByteSearch.cpp
+//       ByteOrder.cpp Varint.cpp FileWriter.cpp MappedFile.cpp
+//       -lboost_thread -lpthread -o mpsc_bench
+//
+// Both rings have the same capacity. The mutex ring writes a 4-byte length
+// before each payload, and its producers back off rather than let the ring
+// overwrite records the consumer has not taken yet.
+
+#include "MpscCircularBuffer.h"
+#include "CircularBuffer.h"
+#include <stdio.h>
+#include <string.h>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace BaseLib;
+
+namespace
+{
+
+const int kProducers = 32;
+const int kRecordsPerProducer = 100000;
+const size_t kRecordSize = 64;
+const size_t kCapacity = 1024 * 1024;
+
+double nowSeconds()
+{
+    static const boost::posix_time::ptime epoch = boost::posix_time::microsec_clock::universal_time();
+    return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+}
+
+struct Counter
+{
+    Counter()
+        :   records(0),
+            bytes(0)
+    {
+    }
+
+    void operator()(const char*, size_t len)
+    {
+        ++records;
+        bytes += len;
+    }
+
+    size_t records;
+    size_t bytes;
+};
+
+/// drain() takes its handler by value
+struct CountInto
+{
+    explicit CountInto(Counter* counter)
+        :   counter_(counter)
+    {
+    }
+
+    void operator()(const char* data, size_t len) const
+    {
+        (*counter_)(data, len);
+    }
+
+    Counter* counter_;
+};
+
+void mpscProducer(MpscCircularBuffer* ring)
+{
+    char record[kRecordSize];
+    memset(record, 'm', sizeof record);
+    for (int i = 0; i < kRecordsPerProducer; ++i)
+    {
+        ring->append(record, sizeof record);
+    }
+}
+
+double runMpsc()
+{
+    MpscCircularBuffer ring(kCapacity);
+    const size_t total = static_cast<size_t>(kProducers) * kRecordsPerProducer;
+    const double start = nowSeconds();
+    boost::thread_group producers;
+    for (int i = 0; i < kProducers; ++i)
+    {
+        producers.create_thread(boost::bind(mpscProducer, &ring));
+    }
+    Counter counter;
+    while (counter.records < total)
+    {
+        if (ring.drain(CountInto(&counter)) == 0)
+        {
+            boost::this_thread::yield();
+        }
+    }
+    const double elapsed = nowSeconds() - start;
+    producers.join_all();
+    return elapsed;
+}
+
+struct LockedRing
+{
+    LockedRing()
+        :   ring(kCapacity)
+    {
+    }
+
+    boost::mutex mutex;
+    CircularBuffer ring;
+};
+
+void mutexProducer(LockedRing* locked)
+{
+    char record[sizeof(uint32_t) + kRecordSize];
+    const uint32_t len = kRecordSize;
+    memcpy(record, &len, sizeof len);
+    memset(record + sizeof len, 'm', kRecordSize);
+    for (int i = 0; i < kRecordsPerProducer; ++i)
+    {
+        for (;;)
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(locked->mutex);
+                if (locked->ring.size() + sizeof record <= locked->ring.capacity())
+                {
+                    locked->ring.append(record, sizeof record);
+                    break;
+                }
+            }
+            boost::this_thread::yield();
+        }
+    }
+}
+
+double runMutex()
+{
+    LockedRing locked;
+    const size_t total = static_cast<size_t>(kProducers) * kRecordsPerProducer;
+    const double start = nowSeconds();
+    boost::thread_group producers;
+    for (int i = 0; i < kProducers; ++i)
+    {
+        producers.create_thread(boost::bind(mutexProducer, &locked));
+    }
+    Counter counter;
+    std::string batch;
+    while (counter.records < total)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(locked.mutex);
+            batch = locked.ring.readAllAsString();
+            locked.ring.clear();
+        }
+        if (batch.empty())
+        {
+            boost::this_thread::yield();
+            continue;
+        }
+        for (size_t pos = 0; pos < batch.size(); )
+        {
+            uint32_t len = 0;
+            memcpy(&len, batch.data() + pos, sizeof len);
+            counter(batch.data() + pos + sizeof len, len);
+            pos += sizeof len + len;
+        }
+    }
+    const double elapsed = nowSeconds() - start;
+    producers.join_all();
+    return elapsed;
+}
+
+}
+
+int main()
+{
+    const double records = static_cast<double>(kProducers) * kRecordsPerProducer;
+    printf("%d producers x %d records of %u bytes, %u-byte rings, %u CPUs\n",
+           kProducers, kRecordsPerProducer, static_cast<unsigned>(kRecordSize),
+           static_cast<unsigned>(kCapacity), boost::thread::hardware_concurrency());
+    for (int round = 0; round < 3; ++round)
+    {
+        const double mutex = runMutex();
+        const double mpsc = runMpsc();
+        printf("mutex CircularBuffer %8.1f ns/record   MpscCircularBuffer %8.1f ns/record   %5.2fx\n",
+               mutex * 1e9 / records, mpsc * 1e9 / records, mutex / mpsc);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "MpscCircularBuffer.h"
+#include <assert.h>
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+
+namespace BaseLib
+{
+
+const size_t MpscCircularBuffer::kHeaderSize;
+const uint32_t MpscCircularBuffer::kCommitted;
+const uint32_t MpscCircularBuffer::kPadding;
+const uint32_t MpscCircularBuffer::kLengthMask;
+
+namespace
+{
+
+const int kSpinsBeforeYield = 64;
+
+size_t roundUpPowerOfTwo(size_t n)
+{
+    size_t size = 1;
+    while (size < n)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+}
+
+MpscCircularBuffer::MpscCircularBuffer(size_t capacity)
+    :   data_(NULL),
+        capacity_(roundUpPowerOfTwo(std::max(capacity, 4*kHeaderSize))),
+        mask_(capacity_ - 1),
+        head_(0),
+        tail_(0)
+{
+    assert(capacity_ - 1 <= kLengthMask);
+    data_ = new char[capacity_];
+    ::memset(data_, 0, capacity_);
+}
+
+MpscCircularBuffer::~MpscCircularBuffer()
+{
+    delete[] data_;
+}
+
+bool MpscCircularBuffer::append(const char* data, size_t len)
+{
+    if (len > maxRecordSize())
+    {
+        return false;
+    }
+    const size_t size = recordSize(len);
+    for (;;)
+    {
+        const size_t pos = tail_.fetch_add(size, boost::memory_order_relaxed);
+        waitForSpace(pos + size);
+        const size_t offset = pos & mask_;
+        const size_t toEnd = capacity_ - offset;
+        if (size <= toEnd)
+        {
+            ::memcpy(data_ + offset + kHeaderSize, data, len);
+            header(offset)->store(kCommitted | static_cast<uint32_t>(len), boost::memory_order_release);
+            return true;
+        }
+        // the claim wraps: turn both pieces into padding and claim again
+        header(offset)->store(kCommitted | kPadding | static_cast<uint32_t>(toEnd),
+                              boost::memory_order_release);
+        header(0)->store(kCommitted | kPadding | static_cast<uint32_t>(size - toEnd),
+                         boost::memory_order_release);
+    }
+}
+
+void MpscCircularBuffer::waitForSpace(size_t end) const
+{
+    int spins = 0;
+    while (end - head_.load(boost::memory_order_acquire) > capacity_)
+    {
+        if (++spins > kSpinsBeforeYield)
+        {
+            boost::this_thread::yield();
+        }
+    }
+}
+
+void MpscCircularBuffer::release(size_t start, size_t end)
+{
+    if (start == end)
+    {
+        return;
+    }
+    const size_t offset = start & mask_;
+    const size_t len = end - start;
+    const size_t first = std::min(len, capacity_ - offset);
+    ::memset(data_ + offset, 0, first);
+    ::memset(data_, 0, len - first);
+    head_.store(end, boost::memory_order_release);
+}
+
+}
@@ -0,0 +1,126 @@
+#ifndef _MPSCCIRCULARBUFFER_H
+#define _MPSCCIRCULARBUFFER_H
+
+#include <string.h>
+#include "stdint.h"
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+
+/// A record ring that any number of threads append to and one thread
+/// drains, with no locks.
+///
+/// @code
+/// +--------+---------+--------+---------+-----+--------+---------+
+/// | header | payload | header | payload | ... | header | (free)  |
+/// +--------+---------+--------+---------+-----+--------+---------+
+///   ^head_ (consumer)                                    ^tail_ (producers)
+/// @endcode
+///
+/// A producer claims header plus payload with one fetch_add on tail_,
+/// copies the payload in and publishes the record by storing its length
+/// and the committed bit into the header (release). Producers never wait
+/// for each other, only for the consumer when the ring is full. The
+/// consumer walks the records in claim order and stops at the first one
+/// that is not committed yet, so records come out in order even though
+/// they are finished out of order.
+///
+/// Records never wrap: a claim that straddles the end of the block is
+/// filled with padding records and claimed again, so drain() hands out
+/// every payload as one contiguous range. The consumer zeroes what it has
+/// drained before giving it back, which is what lets a producer rely on
+/// an untouched header reading as "not committed".
+
+namespace BaseLib
+{
+
+class MpscCircularBuffer : boost::noncopyable
+{
+public:
+    static const size_t kHeaderSize = 8;
+
+    /// capacity is rounded up to a power of two
+    explicit MpscCircularBuffer(size_t capacity);
+    ~MpscCircularBuffer();
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    /// largest payload append() accepts
+    size_t maxRecordSize() const
+    {
+        return capacity_ / 2 - kHeaderSize;
+    }
+
+    /// Thread-safe. Spins, then yields, while the ring is full. Returns
+    /// false only when len is over maxRecordSize().
+    bool append(const char* data, size_t len);
+
+    /// Consumer thread only. Calls handler(const char* data, size_t len)
+    /// for up to maxRecords committed records, oldest first, and returns
+    /// how many it delivered. The pointers are only valid during the call.
+    template <typename Handler>
+    size_t drain(Handler handler, size_t maxRecords = static_cast<size_t>(-1))
+    {
+        const size_t start = head_.load(boost::memory_order_relaxed);
+        size_t head = start;
+        size_t count = 0;
+        // stop after one lap: what lies beyond is not zeroed yet
+        while (count < maxRecords && head - start < capacity_)
+        {
+            const size_t offset = head & mask_;
+            const uint32_t h = header(offset)->load(boost::memory_order_acquire);
+            if ((h & kCommitted) == 0)
+            {
+                break;
+            }
+            if (h & kPadding)
+            {
+                head += h & kLengthMask;
+                continue;
+            }
+            const size_t len = h & kLengthMask;
+            handler(static_cast<const char*>(data_ + offset + kHeaderSize), len);
+            head += recordSize(len);
+            ++count;
+        }
+        release(start, head);
+        return count;
+    }
+
+private:
+    static const uint32_t kCommitted = 0x80000000u;
+    static const uint32_t kPadding = 0x40000000u;
+    static const uint32_t kLengthMask = 0x3fffffffu;
+
+    static size_t recordSize(size_t len)
+    {
+        return (kHeaderSize + len + kHeaderSize - 1) & ~(kHeaderSize - 1);
+    }
+
+    boost::atomic<uint32_t>* header(size_t offset) const
+    {
+        return reinterpret_cast<boost::atomic<uint32_t>*>(data_ + offset);
+    }
+
+    /// blocks until [end - capacity_, end) no longer holds undrained records
+    void waitForSpace(size_t end) const;
+
+    /// zeroes [start, end) and hands it back to the producers
+    void release(size_t start, size_t end);
+
+private:
+    char* data_;
+    size_t capacity_;
+    size_t mask_;
+
+    char pad0_[64];
+    boost::atomic<size_t> head_;
+    char pad1_[64];
+    boost::atomic<size_t> tail_;
+    char pad2_[64];
+};
+
+}
+#endif  // _MPSCCIRCULARBUFFER_H
@@ -0,0 +1,505 @@
+#include "Numa.h"
+#include "ThreadLocal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/tss.hpp>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace BaseLib
+{
+
+namespace
+{
+
+/// how often, in calls, a thread asks the OS again which CPU it is on
+const unsigned kResampleInterval = 64;
+
+/// One thread's counts for one node. Written by that thread only, with a
+/// plain load and store, and read by stats().
+struct NodeCounters
+{
+    NodeCounters()
+        :   localAllocations(0),
+            remoteAllocations(0),
+            localFrees(0),
+            remoteFrees(0)
+    {
+    }
+
+    boost::atomic<uint64_t> localAllocations;
+    boost::atomic<uint64_t> remoteAllocations;
+    boost::atomic<uint64_t> localFrees;
+    boost::atomic<uint64_t> remoteFrees;
+    /// one cache line each, so no two threads' counters share one
+    char pad[64 - 4 * sizeof(boost::atomic<uint64_t>)];
+};
+
+void bump(boost::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+}
+
+void add(Numa::Stats& sum, const NodeCounters& c)
+{
+    sum.localAllocations += c.localAllocations.load(boost::memory_order_relaxed);
+    sum.remoteAllocations += c.remoteAllocations.load(boost::memory_order_relaxed);
+    sum.localFrees += c.localFrees.load(boost::memory_order_relaxed);
+    sum.remoteFrees += c.remoteFrees.load(boost::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+/// Parses a kernel cpu or node list such as "0-3,8-11" into its members.
+std::vector<size_t> parseList(const char* path)
+{
+    std::vector<size_t> members;
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return members;
+    }
+    char line[4096];
+    if (fgets(line, sizeof line, fp))
+    {
+        const char* p = line;
+        while (*p >= '0' && *p <= '9')
+        {
+            char* end = NULL;
+            size_t first = strtoul(p, &end, 10);
+            size_t last = first;
+            if (*end == '-' && end[1] >= '0' && end[1] <= '9')
+            {
+                last = strtoul(end + 1, &end, 10);
+            }
+            for (size_t i = first; i <= last; ++i)
+            {
+                members.push_back(i);
+            }
+            p = *end == ',' ? end + 1 : end;
+        }
+    }
+    fclose(fp);
+    return members;
+}
+#endif
+
+/// The online nodes that have CPUs, numbered 0..nodes-1 in the order the
+/// OS lists them. Memory-only and offline nodes are left out: no thread
+/// ever runs there, so a pool for one would never be used.
+struct Topology
+{
+    Topology()
+        :   nodes(1)
+    {
+#ifdef WIN32
+        ULONG highest = 0;
+        if (::GetNumaHighestNodeNumber(&highest))
+        {
+            for (ULONG id = 0; id <= highest; ++id)
+            {
+                ULONGLONG mask = 0;
+                if (::GetNumaNodeProcessorMask(static_cast<UCHAR>(id), &mask) && mask != 0)
+                {
+                    addNode(id, std::vector<size_t>());
+                }
+            }
+        }
+#elif defined(__linux__)
+        // possible would also count slots for nodes that may be
+        // hot-plugged later, and nodes without CPUs
+        std::vector<size_t> online = parseList("/sys/devices/system/node/online");
+        for (size_t i = 0; i < online.size(); ++i)
+        {
+            char path[64];
+            snprintf(path, sizeof path, "/sys/devices/system/node/node%u/cpulist", static_cast<unsigned>(online[i]));
+            std::vector<size_t> cpus = parseList(path);
+            if (!cpus.empty())
+            {
+                addNode(online[i], cpus);
+            }
+        }
+#endif
+        if (osNode.size() > 1)
+        {
+            nodes = osNode.size();
+        }
+    }
+
+    void addNode(size_t id, const std::vector<size_t>& cpus)
+    {
+        const size_t node = osNode.size();
+        osNode.push_back(id);
+        if (nodeOfOsNode.size() <= id)
+        {
+            nodeOfOsNode.resize(id + 1, 0);
+        }
+        nodeOfOsNode[id] = node;
+        cpusOfNode.push_back(cpus);
+        for (size_t i = 0; i < cpus.size(); ++i)
+        {
+            if (nodeOfCpu.size() <= cpus[i])
+            {
+                nodeOfCpu.resize(cpus[i] + 1, 0);
+            }
+            nodeOfCpu[cpus[i]] = node;
+        }
+    }
+
+    /// asks the OS
+    size_t nodeOfCurrentCpu() const
+    {
+#ifdef WIN32
+        UCHAR id = 0;
+        if (::GetNumaProcessorNode(static_cast<UCHAR>(::GetCurrentProcessorNumber()), &id) && id < nodeOfOsNode.size())
+        {
+            return nodeOfOsNode[id];
+        }
+        return 0;
+#elif defined(__linux__)
+        int cpu = ::sched_getcpu();
+        if (cpu < 0 || static_cast<size_t>(cpu) >= nodeOfCpu.size())
+        {
+            return 0;
+        }
+        return nodeOfCpu[cpu];
+#else
+        return 0;
+#endif
+    }
+
+    size_t nodes;
+    /// the OS's id of each node, and the other way round
+    std::vector<size_t> osNode;
+    std::vector<size_t> nodeOfOsNode;
+    /// Linux only
+    std::vector<size_t> nodeOfCpu;
+    std::vector<std::vector<size_t> > cpusOfNode;
+};
+
+/// never destroyed: pools record frees until the very end
+const Topology& topology()
+{
+    static Topology* t = new Topology;
+    return *t;
+}
+
+class ThreadState;
+
+/// every live ThreadState, and what the ones gone counted
+struct Registry
+{
+    /// value-initialized, so all counts start at zero
+    explicit Registry(size_t nodes)
+        :   retired(nodes),
+            baseline(nodes)
+    {
+    }
+
+    boost::mutex mutex;
+    std::vector<ThreadState*> threads;
+    std::vector<Numa::Stats> retired;
+    /// the totals at the last resetStats()
+    std::vector<Numa::Stats> baseline;
+};
+
+Registry& registry()
+{
+    static Registry* r = new Registry(topology().nodes);
+    return *r;
+}
+
+/// A thread's node, as of its last look, and its counts per node.
+class ThreadState : boost::noncopyable
+{
+public:
+    /// self is the thread-local pointer to this state, cleared when the
+    /// thread exits and the state goes away
+    ThreadState(const Topology& t, ThreadState** self)
+        :   self_(self),
+            topology_(t),
+            counters_(new NodeCounters[t.nodes]),
+            node_(t.nodeOfCurrentCpu()),
+            untilResample_(kResampleInterval)
+    {
+        Registry& r = registry();
+        boost::lock_guard<boost::mutex> lock(r.mutex);
+        r.threads.push_back(this);
+    }
+
+    ~ThreadState()
+    {
+        *self_ = NULL;
+        Registry& r = registry();
+        {
+            boost::lock_guard<boost::mutex> lock(r.mutex);
+            for (size_t i = 0; i < topology_.nodes; ++i)
+            {
+                add(r.retired[i], counters_[i]);
+            }
+            r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+        }
+        delete[] counters_;
+    }
+
+    size_t node()
+    {
+        if (--untilResample_ == 0)
+        {
+            resample();
+        }
+        return node_;
+    }
+
+    void resample()
+    {
+        node_ = topology_.nodeOfCurrentCpu();
+        untilResample_ = kResampleInterval;
+    }
+
+    /// written by this thread only; read by others under the registry mutex
+    NodeCounters& counters(size_t node)
+    {
+        return counters_[node];
+    }
+
+private:
+    ThreadState** self_;
+    const Topology& topology_;
+    NodeCounters* counters_;
+    size_t node_;
+    unsigned untilResample_;
+};
+
+/// only for hosts with more than one node
+ThreadState& threadState(const Topology& t)
+{
+    // a plain thread-local pointer on the hot path; the TSS slot is only
+    // there to delete the state when the thread exits
+    static BASELIB_THREAD_LOCAL ThreadState* state = NULL;
+    static boost::thread_specific_ptr<ThreadState>* owner =
+        new boost::thread_specific_ptr<ThreadState>();
+    if (state == NULL)
+    {
+        state = new ThreadState(t, &state);
+        owner->reset(state);
+    }
+    return *state;
+}
+
+#if defined(__linux__) && defined(SYS_mbind)
+/// prefer the OS's node id for the pages of [p, p+bytes) that are not
+/// faulted in yet
+void preferNode(char* p, size_t bytes, size_t id)
+{
+    const int kMpolPreferred = 1;
+    const size_t bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(id / bits + 1, 0);
+    mask[id / bits] |= 1UL << (id % bits);
+    // best effort: without the policy the pages follow the first touch,
+    // which is the carving thread's node anyway
+    ::syscall(SYS_mbind, p, bytes, kMpolPreferred, &mask[0], mask.size() * bits + 1, 0);
+}
+#endif
+
+}
+
+size_t Numa::nodeCount()
+{
+    return topology().nodes;
+}
+
+size_t Numa::currentNode()
+{
+    const Topology& t = topology();
+    if (t.nodes == 1)
+    {
+        return 0;
+    }
+    return threadState(t).node();
+}
+
+bool Numa::bindThreadToNode(size_t node)
+{
+    const Topology& t = topology();
+    if (node >= t.nodes)
+    {
+        return false;
+    }
+#ifdef WIN32
+    ULONGLONG mask = 0;
+    if (!::GetNumaNodeProcessorMask(static_cast<UCHAR>(t.osNode[node]), &mask) || mask == 0)
+    {
+        return false;
+    }
+    if (::SetThreadAffinityMask(::GetCurrentThread(), static_cast<DWORD_PTR>(mask)) == 0)
+    {
+        return false;
+    }
+    threadState(t).resample();
+    return true;
+#elif defined(__linux__)
+    if (t.nodes == 1)
+    {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < t.cpusOfNode[node].size(); ++i)
+    {
+        if (t.cpusOfNode[node][i] < CPU_SETSIZE)
+        {
+            CPU_SET(t.cpusOfNode[node][i], &set);
+        }
+    }
+    if (::pthread_setaffinity_np(::pthread_self(), sizeof set, &set) != 0)
+    {
+        return false;
+    }
+    threadState(t).resample();
+    return true;
+#else
+    return false;
+#endif
+}
+
+char* Numa::allocatePages(size_t bytes, int node, bool prefault)
+{
+    const Topology& t = topology();
+    const bool placed = node >= 0 && static_cast<size_t>(node) < t.nodes && t.nodes > 1;
+#ifdef WIN32
+    void* p = placed
+        ? ::VirtualAllocExNuma(::GetCurrentProcess(), NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+                               static_cast<DWORD>(t.osNode[node]))
+        : ::VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    if (prefault)
+    {
+        ::memset(p, 0, bytes);
+    }
+#else
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+    // the policy has to be in place before the pages are faulted in
+    if (prefault && !placed)
+    {
+        flags |= MAP_POPULATE;
+        prefault = false;
+    }
+#endif
+    void* p = ::mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+#if defined(__linux__) && defined(SYS_mbind)
+    if (placed)
+    {
+        preferNode(static_cast<char*>(p), bytes, t.osNode[node]);
+    }
+#endif
+    if (prefault)
+    {
+        ::memset(p, 0, bytes);
+    }
+#endif
+    return static_cast<char*>(p);
+}
+
+void Numa::freePages(char* p, size_t bytes)
+{
+#ifdef WIN32
+    (void)bytes;
+    ::VirtualFree(p, 0, MEM_RELEASE);
+#else
+    ::munmap(p, bytes);
+#endif
+}
+
+void Numa::recordAllocation(size_t node)
+{
+    const Topology& t = topology();
+    if (t.nodes > 1 && node < t.nodes)
+    {
+        ThreadState& state = threadState(t);
+        NodeCounters& c = state.counters(node);
+        bump(state.node() == node ? c.localAllocations : c.remoteAllocations);
+    }
+}
+
+void Numa::recordFree(size_t node)
+{
+    const Topology& t = topology();
+    if (t.nodes > 1 && node < t.nodes)
+    {
+        ThreadState& state = threadState(t);
+        NodeCounters& c = state.counters(node);
+        bump(state.node() == node ? c.localFrees : c.remoteFrees);
+    }
+}
+
+namespace
+{
+
+/// everything counted since the process started; under the registry mutex
+Numa::Stats totalLocked(const Registry& r, size_t node)
+{
+    Numa::Stats s = r.retired[node];
+    for (size_t i = 0; i < r.threads.size(); ++i)
+    {
+        add(s, r.threads[i]->counters(node));
+    }
+    return s;
+}
+
+}
+
+Numa::Stats Numa::stats(size_t node)
+{
+    Stats s = { 0, 0, 0, 0 };
+    if (node >= topology().nodes)
+    {
+        return s;
+    }
+    Registry& r = registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    s = totalLocked(r, node);
+    const Stats& base = r.baseline[node];
+    s.localAllocations -= base.localAllocations;
+    s.remoteAllocations -= base.remoteAllocations;
+    s.localFrees -= base.localFrees;
+    s.remoteFrees -= base.remoteFrees;
+    return s;
+}
+
+void Numa::resetStats()
+{
+    Registry& r = registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    for (size_t i = 0; i < r.baseline.size(); ++i)
+    {
+        r.baseline[i] = totalLocked(r, i);
+    }
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef _NUMA_H
+#define _NUMA_H
+
+#include <stddef.h>
+#include "stdint.h"
+
+/// NUMA topology, thread and memory placement, and per-node counters for
+/// the pools that key their memory by node.
+///
+/// A thread's node is simply the node of the CPU it runs on, so a thread
+/// pinned with bindThreadToNode() (IoServicePool can pin its threads this
+/// way) always allocates from its own node's pools. Asking the OS on every
+/// allocation would cost more than the allocation, so each thread only
+/// looks at its CPU again every few dozen calls, and right after it binds
+/// itself. The counters are kept per thread as well; the pools' fast paths
+/// never write to memory another thread writes. On a host with one node
+/// every call here is a no-op or returns node 0 without asking the OS,
+/// and nothing is counted.
+
+namespace BaseLib
+{
+
+class Numa
+{
+public:
+    /// what the pools of one node have handed out and taken back; local
+    /// means the calling thread was on that node as of its last look
+    struct Stats
+    {
+        uint64_t localAllocations;
+        uint64_t remoteAllocations;
+        uint64_t localFrees;
+        uint64_t remoteFrees;
+    };
+
+    /// At least 1. Only online nodes with CPUs count, numbered densely
+    /// from 0 whatever ids the OS gives them, and every node argument
+    /// below is such a number.
+    static size_t nodeCount();
+
+    /// node of the CPU the calling thread was running on when it last
+    /// looked; cheap enough to call on every allocation
+    static size_t currentNode();
+
+    /// Restricts the calling thread to the CPUs of node; false on a
+    /// single-node host, for a node out of range, or if the OS refused.
+    static bool bindThreadToNode(size_t node);
+
+    /// Whole pages straight from the OS, placed on node (no preference if
+    /// node is negative) and optionally faulted in right away. Throws
+    /// std::bad_alloc.
+    static char* allocatePages(size_t bytes, int node, bool prefault);
+
+    static void freePages(char* p, size_t bytes);
+
+    /// called by the allocators that carve node memory for every block of
+    /// node they hand out or take back; caches layered on them do not
+    /// count the same block again
+    static void recordAllocation(size_t node);
+    static void recordFree(size_t node);
+
+    /// sums the counters of every thread, under a lock
+    static Stats stats(size_t node);
+
+    /// makes stats() count from now on
+    static void resetStats();
+
+private:
+    Numa();
+};
+
+}
+#endif  // _NUMA_H
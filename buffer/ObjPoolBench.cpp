@@ -0,0 +1,129 @@
+// Creating n objects and destroying them all again in random order,
+// through CObjPool and through the boost::object_pool behind a mutex that
+// CObjPool was built on before, for n up to a million live objects.
+//
+//   g++ -O2 -I.. ObjPoolBench.cpp SlotAllocator.cpp Numa.cpp PoolStats.cpp
+//       -lboost_thread -lpthread -o objpool_bench
+//
+// object_pool::destroy() keeps its free list sorted, so every destroy
+// walks it; the million-object round is skipped for it, as it would run
+// for hours.
+
+#include "CObjPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <boost/pool/object_pool.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace BaseLib;
+
+namespace
+{
+
+struct Session
+{
+    Session()
+        :   id(0)
+    {
+    }
+
+    uint64_t id;
+    char state[56];
+};
+
+double nowSeconds()
+{
+    static const boost::posix_time::ptime epoch = boost::posix_time::microsec_clock::universal_time();
+    return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+}
+
+/// the same permutation of 0..n-1 for both pools
+std::vector<size_t> shuffled(size_t n)
+{
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        order[i] = i;
+    }
+    srand(12345);
+    for (size_t i = n; i > 1; --i)
+    {
+        std::swap(order[i - 1], order[static_cast<size_t>(rand()) % i]);
+    }
+    return order;
+}
+
+/// ns per create and per destroy
+void runPool(size_t n, const std::vector<size_t>& order, double& create, double& destroy)
+{
+    CObjPool<Session> pool("bench");
+    std::vector<CObjPool<Session>::Handle> live(n);
+    double start = nowSeconds();
+    for (size_t i = 0; i < n; ++i)
+    {
+        live[i] = pool.CreateHandle();
+    }
+    create = (nowSeconds() - start) * 1e9 / n;
+    start = nowSeconds();
+    for (size_t i = 0; i < n; ++i)
+    {
+        live[order[i]].reset();
+    }
+    destroy = (nowSeconds() - start) * 1e9 / n;
+}
+
+void runLegacy(size_t n, const std::vector<size_t>& order, double& create, double& destroy)
+{
+    boost::object_pool<Session> pool;
+    boost::mutex mutex;
+    std::vector<Session*> live(n);
+    double start = nowSeconds();
+    for (size_t i = 0; i < n; ++i)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        live[i] = pool.construct();
+    }
+    create = (nowSeconds() - start) * 1e9 / n;
+    start = nowSeconds();
+    for (size_t i = 0; i < n; ++i)
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        if (pool.is_from(live[order[i]]))
+        {
+            pool.destroy(live[order[i]]);
+        }
+    }
+    destroy = (nowSeconds() - start) * 1e9 / n;
+}
+
+}
+
+int main()
+{
+    const size_t sizes[] = { 10000, 100000, 1000000 };
+    printf("%-10s %24s %24s\n", "", "object_pool + mutex", "CObjPool");
+    printf("%-10s %12s %11s %12s %11s\n", "live", "create ns", "destroy ns", "create ns", "destroy ns");
+    for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; ++i)
+    {
+        const size_t n = sizes[i];
+        const std::vector<size_t> order = shuffled(n);
+        double create = 0, destroy = 0;
+        printf("%-10lu", static_cast<unsigned long>(n));
+        if (n <= 100000)
+        {
+            runLegacy(n, order, create, destroy);
+            printf(" %12.1f %11.1f", create, destroy);
+        }
+        else
+        {
+            printf(" %12s %11s", "skipped", "skipped");
+        }
+        runPool(n, order, create, destroy);
+        printf(" %12.1f %11.1f\n", create, destroy);
+    }
+    return 0;
+}
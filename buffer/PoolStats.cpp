@@ -0,0 +1,171 @@
+#include "PoolStats.h"
+#include <algorithm>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace BaseLib
+{
+
+namespace
+{
+
+struct Entry
+{
+    Entry(const void* pool, uint64_t id, const PoolRegistry::StatsFunction& stats)
+        :   pool(pool),
+            id(id),
+            stats(stats)
+    {
+    }
+
+    const void* pool;
+    uint64_t id;
+    PoolRegistry::StatsFunction stats;
+};
+
+typedef std::vector<Entry> Entries;
+
+boost::mutex& registryMutex()
+{
+    static boost::mutex* mutex = new boost::mutex;
+    return *mutex;
+}
+
+/// never destroyed: pools with static storage remove themselves late
+Entries& entries()
+{
+    static Entries* pools = new Entries;
+    return *pools;
+}
+
+/// under registryMutex(); 0 stays free for stats outside any snapshot
+uint64_t g_lastId = 0;
+
+bool idLess(const PoolStats& s, uint64_t id)
+{
+    return s.poolId < id;
+}
+
+double perSecond(uint64_t count, uint64_t nanos)
+{
+    return nanos == 0 ? 0.0 : static_cast<double>(count) * 1e9 / static_cast<double>(nanos);
+}
+
+}
+
+PoolStats::PoolStats()
+    :   poolId(0),
+        slotSize(0),
+        allocations(0),
+        frees(0),
+        live(0),
+        peak(0),
+        slabs(0),
+        reservedBytes(0),
+        lockContentions(0),
+        lockWaitNanos(0),
+        takenAtNanos(0)
+{
+}
+
+PoolStats& PoolStats::operator += (const PoolStats& rhs)
+{
+    allocations += rhs.allocations;
+    frees += rhs.frees;
+    live += rhs.live;
+    peak += rhs.peak;
+    slabs += rhs.slabs;
+    reservedBytes += rhs.reservedBytes;
+    lockContentions += rhs.lockContentions;
+    lockWaitNanos += rhs.lockWaitNanos;
+    if (rhs.takenAtNanos > takenAtNanos)
+    {
+        takenAtNanos = rhs.takenAtNanos;
+    }
+    return *this;
+}
+
+double PoolStats::allocationRate(const PoolStats& earlier) const
+{
+    if (earlier.poolId != poolId)
+    {
+        return 0.0;
+    }
+    return perSecond(allocations - earlier.allocations, takenAtNanos - earlier.takenAtNanos);
+}
+
+double PoolStats::freeRate(const PoolStats& earlier) const
+{
+    if (earlier.poolId != poolId)
+    {
+        return 0.0;
+    }
+    return perSecond(frees - earlier.frees, takenAtNanos - earlier.takenAtNanos);
+}
+
+uint64_t PoolStats::nowNanos()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+    {
+        ::QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER now;
+    ::QueryPerformanceCounter(&now);
+    return static_cast<uint64_t>(static_cast<double>(now.QuadPart) * 1e9 / static_cast<double>(frequency.QuadPart));
+#else
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void PoolRegistry::add(const void* pool, const StatsFunction& stats)
+{
+    boost::lock_guard<boost::mutex> lock(registryMutex());
+    entries().push_back(Entry(pool, ++g_lastId, stats));
+}
+
+void PoolRegistry::remove(const void* pool)
+{
+    boost::lock_guard<boost::mutex> lock(registryMutex());
+    Entries& pools = entries();
+    for (Entries::iterator it = pools.begin(); it != pools.end(); ++it)
+    {
+        if (it->pool == pool)
+        {
+            pools.erase(it);
+            return;
+        }
+    }
+}
+
+std::vector<PoolStats> PoolRegistry::snapshot()
+{
+    // under the lock, so no pool can go away while it is being read
+    boost::lock_guard<boost::mutex> lock(registryMutex());
+    const Entries& pools = entries();
+    std::vector<PoolStats> all;
+    all.reserve(pools.size());
+    for (size_t i = 0; i < pools.size(); ++i)
+    {
+        all.push_back(pools[i].stats());
+        all.back().poolId = pools[i].id;
+    }
+    return all;
+}
+
+const PoolStats* PoolRegistry::find(const std::vector<PoolStats>& snapshot, uint64_t poolId)
+{
+    std::vector<PoolStats>::const_iterator it = std::lower_bound(snapshot.begin(), snapshot.end(), poolId, idLess);
+    return it != snapshot.end() && it->poolId == poolId ? &*it : NULL;
+}
+
+}
@@ -0,0 +1,101 @@
+#ifndef _POOLSTATS_H
+#define _POOLSTATS_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "stdint.h"
+#include <boost/function.hpp>
+
+/// Counters of an object pool, and a registry of every live pool.
+///
+/// A snapshot costs one pass over the pool's thread caches under its
+/// depot lock; the allocation paths themselves only bump counters that
+/// belong to the calling thread. Rates come from comparing two snapshots
+/// of the same pool. Pools can be made and destroyed between two
+/// snapshots, so match them up by poolId rather than by position:
+///
+/// @code
+/// std::vector<PoolStats> before = PoolRegistry::snapshot();
+/// ... sleep ...
+/// std::vector<PoolStats> after = PoolRegistry::snapshot();
+/// for (size_t i = 0; i < after.size(); ++i)
+/// {
+///     if (const PoolStats* earlier = PoolRegistry::find(before, after[i].poolId))
+///     {
+///         double perSecond = after[i].allocationRate(*earlier);
+///     }
+/// }
+/// @endcode
+
+namespace BaseLib
+{
+
+struct PoolStats
+{
+    PoolStats();
+
+    /// Set by PoolRegistry::snapshot(): unique to one pool for the life of
+    /// the process, never reused even if a new pool lands at the address
+    /// of a destroyed one. 0 for stats that did not come from a snapshot.
+    uint64_t poolId;
+    std::string name;
+    /// bytes of one slot
+    size_t slotSize;
+
+    /// totals since the pool was made
+    uint64_t allocations;
+    uint64_t frees;
+    /// objects out right now, and the most there have been at once; the
+    /// peak is taken whenever a thread cache goes to the depot, so it can
+    /// miss a spike by up to two magazines per thread
+    uint64_t live;
+    uint64_t peak;
+
+    size_t slabs;
+    /// bytes of all slabs mapped from the OS
+    size_t reservedBytes;
+
+    /// times the depot lock was already taken, and the total time spent
+    /// waiting for it
+    uint64_t lockContentions;
+    uint64_t lockWaitNanos;
+
+    /// monotonic clock when the snapshot was taken
+    uint64_t takenAtNanos;
+
+    /// adds rhs's counters; keeps poolId, name and slotSize
+    PoolStats& operator += (const PoolStats& rhs);
+
+    /// per second between earlier and this snapshot of the same pool; 0
+    /// if earlier is a snapshot of another pool
+    double allocationRate(const PoolStats& earlier) const;
+    double freeRate(const PoolStats& earlier) const;
+
+    /// the clock takenAtNanos and lockWaitNanos are measured with
+    static uint64_t nowNanos();
+};
+
+class PoolRegistry
+{
+public:
+    typedef boost::function<PoolStats ()> StatsFunction;
+
+    /// pools add themselves when made and remove themselves when destroyed
+    static void add(const void* pool, const StatsFunction& stats);
+    static void remove(const void* pool);
+
+    /// a snapshot of every live pool, in the order they were made, which
+    /// is also the order of their poolIds
+    static std::vector<PoolStats> snapshot();
+
+    /// the stats of pool poolId in a snapshot; NULL if that pool was not
+    /// alive when it was taken
+    static const PoolStats* find(const std::vector<PoolStats>& snapshot, uint64_t poolId);
+
+private:
+    PoolRegistry();
+};
+
+}
+#endif  // _POOLSTATS_H
@@ -0,0 +1,320 @@
+#include "SizeClassAllocator.h"
+#include "Numa.h"
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+namespace BaseLib
+{
+
+const size_t SizeClassAllocator::kNumClasses;
+const size_t SizeClassAllocator::kMaxSize;
+const size_t SizeClassAllocator::kBatchSize;
+
+namespace
+{
+
+const size_t kHeaderSize = 16;
+const size_t kMinSlabBytes = 64*1024;
+
+class ThreadHeap;
+
+/// in front of every block; for blocks above kMaxSize owner is NULL and
+/// sizeClass holds the size
+struct BlockHeader
+{
+    ThreadHeap* owner;
+    size_t sizeClass;
+};
+
+/// free blocks are linked through their first payload bytes
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+BlockHeader* headerOf(const void* p)
+{
+    return reinterpret_cast<BlockHeader*>(const_cast<char*>(static_cast<const char*>(p) - kHeaderSize));
+}
+
+/// 16, 32, 48, 64, then four classes per power of two: 80, 96, 112, 128, 160, ...
+size_t classSize(size_t index)
+{
+    if (index < 4)
+    {
+        return 16 * (index + 1);
+    }
+    size_t p = size_t(64) << ((index - 4) / 4);
+    return p + ((index - 4) % 4 + 1) * (p / 4);
+}
+
+size_t classIndex(size_t size)
+{
+    assert(size <= SizeClassAllocator::kMaxSize);
+    if (size <= 64)
+    {
+        return size == 0 ? 0 : (size + 15) / 16 - 1;
+    }
+    size_t lg = 6;
+    while ((size_t(1) << (lg + 1)) < size)
+    {
+        ++lg;
+    }
+    const size_t p = size_t(1) << lg;
+    const size_t step = p / 4;
+    return 4 + (lg - 6) * 4 + (size - p + step - 1) / step - 1;
+}
+
+class ThreadHeap : boost::noncopyable
+{
+public:
+    explicit ThreadHeap(size_t node)
+        :   node_(node),
+            inbox_(NULL),
+            pendingOwner_(NULL),
+            pendingHead_(NULL),
+            pendingTail_(NULL),
+            pendingCount_(0)
+    {
+        for (size_t i = 0; i < SizeClassAllocator::kNumClasses; ++i)
+        {
+            lists_[i] = NULL;
+            cursor_[i] = NULL;
+            limit_[i] = NULL;
+        }
+    }
+
+    size_t node() const
+    {
+        return node_;
+    }
+
+    void* allocate(size_t index)
+    {
+        FreeBlock* block = lists_[index];
+        if (block == NULL)
+        {
+            drainInbox();
+            block = lists_[index];
+        }
+        if (block)
+        {
+            lists_[index] = block->next;
+            return block;
+        }
+        return carve(index);
+    }
+
+    void deallocate(void* p)
+    {
+        BlockHeader* header = headerOf(p);
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        if (header->owner == this)
+        {
+            block->next = lists_[header->sizeClass];
+            lists_[header->sizeClass] = block;
+            return;
+        }
+        if (header->owner != pendingOwner_)
+        {
+            flushPending();
+            pendingOwner_ = header->owner;
+        }
+        block->next = pendingHead_;
+        pendingHead_ = block;
+        if (pendingTail_ == NULL)
+        {
+            pendingTail_ = block;
+        }
+        if (++pendingCount_ == SizeClassAllocator::kBatchSize)
+        {
+            flushPending();
+        }
+    }
+
+    void flushPending()
+    {
+        if (pendingHead_)
+        {
+            pendingOwner_->receive(pendingHead_, pendingTail_);
+        }
+        pendingOwner_ = NULL;
+        pendingHead_ = NULL;
+        pendingTail_ = NULL;
+        pendingCount_ = 0;
+    }
+
+private:
+    /// called by other threads: one CAS for a whole batch
+    void receive(FreeBlock* first, FreeBlock* last)
+    {
+        FreeBlock* head = inbox_.load(boost::memory_order_relaxed);
+        do
+        {
+            last->next = head;
+        } while (!inbox_.compare_exchange_weak(head, first, boost::memory_order_release,
+                                               boost::memory_order_relaxed));
+    }
+
+    void drainInbox()
+    {
+        FreeBlock* block = inbox_.exchange(NULL, boost::memory_order_acquire);
+        while (block)
+        {
+            FreeBlock* next = block->next;
+            size_t index = headerOf(block)->sizeClass;
+            block->next = lists_[index];
+            lists_[index] = block;
+            block = next;
+        }
+    }
+
+    void* carve(size_t index)
+    {
+        const size_t blockBytes = kHeaderSize + classSize(index);
+        if (cursor_[index] == NULL || static_cast<size_t>(limit_[index] - cursor_[index]) < blockBytes)
+        {
+            const size_t slabBytes = (std::max(kMinSlabBytes, 4 * blockBytes) + kMinSlabBytes - 1)
+                                     / kMinSlabBytes * kMinSlabBytes;
+            cursor_[index] = Numa::allocatePages(slabBytes, static_cast<int>(node_), false);
+            limit_[index] = cursor_[index] + slabBytes;
+        }
+        BlockHeader* header = reinterpret_cast<BlockHeader*>(cursor_[index]);
+        header->owner = this;
+        header->sizeClass = index;
+        cursor_[index] += blockBytes;
+        return reinterpret_cast<char*>(header) + kHeaderSize;
+    }
+
+private:
+    /// NUMA node the slabs are placed on: where the first owner ran
+    const size_t node_;
+    FreeBlock* lists_[SizeClassAllocator::kNumClasses];
+    /// unused rest of each class's current slab
+    char* cursor_[SizeClassAllocator::kNumClasses];
+    char* limit_[SizeClassAllocator::kNumClasses];
+
+    /// blocks other threads have handed back
+    boost::atomic<FreeBlock*> inbox_;
+
+    /// blocks of pendingOwner_ freed here, not yet handed back
+    ThreadHeap* pendingOwner_;
+    FreeBlock* pendingHead_;
+    FreeBlock* pendingTail_;
+    size_t pendingCount_;
+};
+
+boost::mutex& idleMutex()
+{
+    static boost::mutex* mutex = new boost::mutex;
+    return *mutex;
+}
+
+/// heaps of exited threads, waiting for a new thread to take them over
+std::vector<ThreadHeap*>& idleHeaps()
+{
+    static std::vector<ThreadHeap*>* heaps = new std::vector<ThreadHeap*>;
+    return *heaps;
+}
+
+void retireHeap(ThreadHeap* heap)
+{
+    heap->flushPending();
+    boost::lock_guard<boost::mutex> lock(idleMutex());
+    idleHeaps().push_back(heap);
+}
+
+ThreadHeap& threadHeap()
+{
+    // never destroyed, like the heaps themselves: blocks may be freed
+    // after every other static object is gone
+    static boost::thread_specific_ptr<ThreadHeap>* heaps =
+        new boost::thread_specific_ptr<ThreadHeap>(retireHeap);
+    ThreadHeap* heap = heaps->get();
+    if (heap == NULL)
+    {
+        // only a heap on this thread's node keeps the thread's blocks local
+        const size_t node = Numa::currentNode();
+        {
+            boost::lock_guard<boost::mutex> lock(idleMutex());
+            std::vector<ThreadHeap*>& idle = idleHeaps();
+            for (size_t i = idle.size(); i > 0; --i)
+            {
+                if (idle[i - 1]->node() == node)
+                {
+                    heap = idle[i - 1];
+                    idle.erase(idle.begin() + (i - 1));
+                    break;
+                }
+            }
+        }
+        if (heap == NULL)
+        {
+            heap = new ThreadHeap(node);
+        }
+        heaps->reset(heap);
+    }
+    return *heap;
+}
+
+}
+
+size_t SizeClassAllocator::roundUp(size_t size)
+{
+    return size <= kMaxSize ? classSize(classIndex(size)) : size;
+}
+
+void* SizeClassAllocator::allocate(size_t size)
+{
+    if (size > kMaxSize)
+    {
+        BlockHeader* header = static_cast<BlockHeader*>(::operator new(kHeaderSize + size));
+        header->owner = NULL;
+        header->sizeClass = size;
+        return reinterpret_cast<char*>(header) + kHeaderSize;
+    }
+    ThreadHeap& heap = threadHeap();
+    Numa::recordAllocation(heap.node());
+    return heap.allocate(classIndex(size));
+}
+
+void SizeClassAllocator::deallocate(void* p)
+{
+    if (p == NULL)
+    {
+        return;
+    }
+    BlockHeader* header = headerOf(p);
+    if (header->owner == NULL)
+    {
+        ::operator delete(header);
+        return;
+    }
+    Numa::recordFree(header->owner->node());
+    threadHeap().deallocate(p);
+}
+
+size_t SizeClassAllocator::usableSize(const void* p)
+{
+    const BlockHeader* header = headerOf(p);
+    return header->owner == NULL ? header->sizeClass : classSize(header->sizeClass);
+}
+
+int SizeClassAllocator::nodeOf(const void* p)
+{
+    const BlockHeader* header = headerOf(p);
+    return header->owner == NULL ? -1 : static_cast<int>(header->owner->node());
+}
+
+void SizeClassAllocator::flush()
+{
+    threadHeap().flushPending();
+}
+
+}
@@ -0,0 +1,139 @@
+#ifndef _SIZECLASSALLOCATOR_H
+#define _SIZECLASSALLOCATOR_H
+
+#include <stddef.h>
+#include <new>
+
+/// A general allocator for variable-size blocks, carved from per-thread
+/// slabs by size class; the variable-size counterpart of CObjPool.
+///
+/// Sizes up to kMaxSize are rounded to one of kNumClasses classes, four
+/// per power of two, so at most a quarter of a block is slack. Each
+/// thread owns a heap with a free list and a slab per class; a block
+/// always goes back to the heap that carved it:
+///
+///  - freed on its own thread, it is pushed on the local free list;
+///  - freed on another thread, it joins that thread's pending batch for
+///    the owner, and once kBatchSize blocks have piled up (or the freeing
+///    thread frees for a different owner, calls flush() or exits) the
+///    whole batch is handed over with a single CAS on the owner's inbox.
+///    The owner empties its inbox when a free list runs dry.
+///
+/// A heap's slabs are placed on the NUMA node its thread was running on
+/// when the heap was made, and every block is counted in Numa::stats().
+/// A thread that exits leaves its heap, blocks still out included, to
+/// the next thread that starts on the same node. Larger blocks go
+/// straight to the heap.
+
+namespace BaseLib
+{
+
+class SizeClassAllocator
+{
+public:
+    static const size_t kNumClasses = 44;
+    static const size_t kMaxSize = 64*1024;
+    static const size_t kBatchSize = 32;
+
+    /// the size the block for size bytes really has
+    static size_t roundUp(size_t size);
+
+    /// never returns NULL; throws std::bad_alloc
+    static void* allocate(size_t size);
+
+    /// p from allocate(), on any thread; NULL is ignored
+    static void deallocate(void* p);
+
+    /// usable bytes of the block at p
+    static size_t usableSize(const void* p);
+
+    /// NUMA node the block at p lives on, or -1 for a block above kMaxSize
+    static int nodeOf(const void* p);
+
+    /// hands the calling thread's pending cross-thread frees to their
+    /// owners now instead of when the batch fills
+    static void flush();
+
+private:
+    SizeClassAllocator();
+};
+
+/// Standard allocator over SizeClassAllocator, e.g. for putting a
+/// shared_ptr's control block in a size-class slab as well.
+template <class T>
+class SizeClassStdAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef SizeClassStdAllocator<U> other;
+    };
+
+    SizeClassStdAllocator()
+    {
+    }
+
+    template <class U>
+    SizeClassStdAllocator(const SizeClassStdAllocator<U>&)
+    {
+    }
+
+    pointer address(reference x) const
+    {
+        return &x;
+    }
+
+    const_pointer address(const_reference x) const
+    {
+        return &x;
+    }
+
+    pointer allocate(size_type n, const void* = 0)
+    {
+        return static_cast<pointer>(SizeClassAllocator::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(pointer p, size_type)
+    {
+        SizeClassAllocator::deallocate(p);
+    }
+
+    size_type max_size() const
+    {
+        return static_cast<size_type>(-1) / sizeof(T);
+    }
+
+    void construct(pointer p, const T& value)
+    {
+        new (p) T(value);
+    }
+
+    void destroy(pointer p)
+    {
+        p->~T();
+    }
+};
+
+template <class T, class U>
+bool operator == (const SizeClassStdAllocator<T>&, const SizeClassStdAllocator<U>&)
+{
+    return true;
+}
+
+template <class T, class U>
+bool operator != (const SizeClassStdAllocator<T>&, const SizeClassStdAllocator<U>&)
+{
+    return false;
+}
+
+}
+#endif  // _SIZECLASSALLOCATOR_H
@@ -0,0 +1,666 @@
+#include "SlotAllocator.h"
+#include "Numa.h"
+#include "PoolStats.h"
+#include "ThreadLocal.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/stack.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace BaseLib
+{
+
+const size_t SlotAllocator::kMagazineSize;
+const size_t SlotAllocator::kSlabBytes;
+
+namespace
+{
+
+struct Magazine
+{
+    size_t count;
+    void* slots[SlotAllocator::kMagazineSize];
+};
+
+boost::mutex& indexMutex()
+{
+    static boost::mutex* mutex = new boost::mutex;
+    return *mutex;
+}
+
+/// indexes of destroyed depots, handed out again before new ones
+std::vector<size_t>& freeIndexes()
+{
+    static std::vector<size_t>* indexes = new std::vector<size_t>;
+    return *indexes;
+}
+
+size_t takeIndex()
+{
+    static size_t next = 0;
+    boost::lock_guard<boost::mutex> lock(indexMutex());
+    std::vector<size_t>& indexes = freeIndexes();
+    if (indexes.empty())
+    {
+        return next++;
+    }
+    // the lowest, to keep the per-thread tables short
+    std::vector<size_t>::iterator lowest = std::min_element(indexes.begin(), indexes.end());
+    const size_t index = *lowest;
+    indexes.erase(lowest);
+    return index;
+}
+
+void releaseIndex(size_t index)
+{
+    boost::lock_guard<boost::mutex> lock(indexMutex());
+    freeIndexes().push_back(index);
+}
+
+}
+
+SlotAllocator::LiveCount::LiveCount()
+    :   live_(0),
+        peak_(0)
+{
+}
+
+void SlotAllocator::LiveCount::add(int64_t delta)
+{
+    int64_t now = live_.fetch_add(delta, boost::memory_order_relaxed) + delta;
+    int64_t high = peak_.load(boost::memory_order_relaxed);
+    while (now > high && !peak_.compare_exchange_weak(high, now, boost::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t SlotAllocator::LiveCount::live() const
+{
+    // frees reported ahead of the allocations they match can make it
+    // briefly negative
+    return static_cast<uint64_t>(std::max(live_.load(boost::memory_order_relaxed), int64_t(0)));
+}
+
+uint64_t SlotAllocator::LiveCount::peak() const
+{
+    return static_cast<uint64_t>(std::max(peak_.load(boost::memory_order_relaxed), int64_t(0)));
+}
+
+struct SlotAllocator::Depot : boost::noncopyable
+{
+    Depot(size_t size, int numaNode, const boost::shared_ptr<LiveCount>& poolCount)
+        :   index(takeIndex()),
+            slotSize(size),
+            node(numaNode),
+            slabBytes((std::max(kSlabBytes, size * kMagazineSize) + kSlabBytes - 1) / kSlabBytes * kSlabBytes),
+            slotsPerSlab(slabBytes / size),
+            full(64),
+            empty(64),
+            current(NULL),
+            cursor(NULL),
+            limit(NULL),
+            retiredAllocations(0),
+            retiredFrees(0),
+            pool(poolCount),
+            lockContentions(0),
+            lockWaitNanos(0)
+    {
+    }
+
+    /// holds mutex, timing the wait when another thread already has it
+    class Lock : boost::noncopyable
+    {
+    public:
+        explicit Lock(Depot& depot)
+            :   depot_(depot)
+        {
+            if (!depot_.mutex.try_lock())
+            {
+                const uint64_t start = PoolStats::nowNanos();
+                depot_.mutex.lock();
+                ++depot_.lockContentions;
+                depot_.lockWaitNanos += PoolStats::nowNanos() - start;
+            }
+        }
+
+        ~Lock()
+        {
+            depot_.mutex.unlock();
+        }
+
+    private:
+        Depot& depot_;
+    };
+
+    ~Depot()
+    {
+        Magazine* m = NULL;
+        while (full.pop(m))
+        {
+            delete m;
+        }
+        while (empty.pop(m))
+        {
+            delete m;
+        }
+        for (size_t i = 0; i < slabs.size(); ++i)
+        {
+            Numa::freePages(slabs[i], slabBytes);
+        }
+        releaseIndex(index);
+    }
+
+    Magazine* takeEmpty()
+    {
+        Magazine* m = NULL;
+        if (!empty.pop(m))
+        {
+            m = new Magazine;
+        }
+        m->count = 0;
+        return m;
+    }
+
+    /// kMagazineSize never used slots, bumped off the current slab
+    size_t carve(void** out)
+    {
+        Lock lock(*this);
+        return carveLocked(out, false);
+    }
+
+    size_t carveLocked(void** out, bool prefault)
+    {
+        for (size_t n = 0; n < kMagazineSize; ++n)
+        {
+            if (cursor == limit)
+            {
+                char* slab = Numa::allocatePages(slabBytes, node, prefault);
+                slabs.push_back(slab);
+                current = slab;
+                cursor = slab;
+                limit = slab + slotsPerSlab * slotSize;
+            }
+            out[n] = cursor;
+            cursor += slotSize;
+        }
+        return kMagazineSize;
+    }
+
+    /// carves until n slots exist, touching the new slabs' pages
+    void reserve(size_t n)
+    {
+        Lock lock(*this);
+        while (carvedLocked() < n)
+        {
+            Magazine* m = takeEmpty();
+            m->count = carveLocked(m->slots, true);
+            full.push(m);
+        }
+    }
+
+    size_t carvedLocked() const
+    {
+        size_t n = slabs.size() * slotsPerSlab;
+        if (current)
+        {
+            n -= (limit - cursor) / slotSize;
+        }
+        return n;
+    }
+
+    /// Gives back every slab none of whose slots is allocated or sitting
+    /// in a thread cache, and the spare magazines.
+    void trim()
+    {
+        Lock lock(*this);
+        std::vector<void*> freeSlots;
+        Magazine* m = NULL;
+        while (full.pop(m))
+        {
+            freeSlots.insert(freeSlots.end(), m->slots, m->slots + m->count);
+            delete m;
+        }
+        while (empty.pop(m))
+        {
+            delete m;
+        }
+        std::sort(slabs.begin(), slabs.end());
+        std::sort(freeSlots.begin(), freeSlots.end());
+
+        std::vector<char*> kept;
+        std::vector<void*>::const_iterator slot = freeSlots.begin();
+        for (size_t i = 0; i < slabs.size(); ++i)
+        {
+            char* slab = slabs[i];
+            std::vector<void*>::const_iterator first = slot;
+            while (slot != freeSlots.end() && static_cast<char*>(*slot) < slab + slabBytes)
+            {
+                ++slot;
+            }
+            const size_t carved = slab == current ? (cursor - slab) / slotSize : slotsPerSlab;
+            if (static_cast<size_t>(slot - first) == carved)
+            {
+                Numa::freePages(slab, slabBytes);
+                if (slab == current)
+                {
+                    current = cursor = limit = NULL;
+                }
+                continue;
+            }
+            kept.push_back(slab);
+            for (; first != slot; )
+            {
+                Magazine* refill = takeEmpty();
+                while (first != slot && refill->count < kMagazineSize)
+                {
+                    refill->slots[refill->count++] = *first++;
+                }
+                full.push(refill);
+            }
+        }
+        slabs.swap(kept);
+    }
+
+    void enlist(ThreadCache* cache)
+    {
+        Lock lock(*this);
+        caches.push_back(cache);
+    }
+
+    /// folds the counts of a cache that is going away into the totals
+    void retire(ThreadCache* cache, uint64_t allocations, uint64_t frees)
+    {
+        Lock lock(*this);
+        retiredAllocations += allocations;
+        retiredFrees += frees;
+        caches.erase(std::find(caches.begin(), caches.end(), cache));
+    }
+
+    /// adds a thread's change in objects out since it last reported
+    void publish(int64_t delta)
+    {
+        own.add(delta);
+        if (pool)
+        {
+            pool->add(delta);
+        }
+    }
+
+    PoolStats stats();
+
+    /// p is the start of a slot carved here; linear in the slab count
+    bool owns(const void* p)
+    {
+        Lock lock(*this);
+        const char* c = static_cast<const char*>(p);
+        for (size_t i = 0; i < slabs.size(); ++i)
+        {
+            if (c >= slabs[i] && c < slabs[i] + slotsPerSlab * slotSize)
+            {
+                return (c - slabs[i]) % slotSize == 0 && !(slabs[i] == current && c >= cursor);
+            }
+        }
+        return false;
+    }
+
+    /// small and dense among live depots; where the thread caches of this
+    /// depot sit in each thread's ThreadCaches
+    const size_t index;
+    const size_t slotSize;
+    /// NUMA node the slabs are placed on, or -1
+    const int node;
+    const size_t slabBytes;
+    const size_t slotsPerSlab;
+    /// magazines holding free slots, and spare ones holding none
+    boost::lockfree::stack<Magazine*> full;
+    boost::lockfree::stack<Magazine*> empty;
+
+    boost::mutex mutex;
+    std::vector<char*> slabs;
+    /// the slab being carved, and its next and end slot
+    char* current;
+    char* cursor;
+    char* limit;
+
+    /// under mutex: every live thread cache, and the counts of those gone
+    std::vector<ThreadCache*> caches;
+    uint64_t retiredAllocations;
+    uint64_t retiredFrees;
+
+    /// objects out as last reported by the thread caches, of this
+    /// allocator and of the pool it is part of
+    LiveCount own;
+    const boost::shared_ptr<LiveCount> pool;
+
+    /// under mutex
+    uint64_t lockContentions;
+    uint64_t lockWaitNanos;
+};
+
+class SlotAllocator::ThreadCache : boost::noncopyable
+{
+public:
+    explicit ThreadCache(const boost::shared_ptr<Depot>& depot)
+        :   depot_(depot),
+            count_(0),
+            allocations_(0),
+            frees_(0),
+            published_(0)
+    {
+        depot_->enlist(this);
+    }
+
+    ~ThreadCache()
+    {
+        flushAll();
+        depot_->retire(this, allocations(), frees());
+    }
+
+    /// written by the owning thread only, read by Depot::stats()
+    uint64_t allocations() const
+    {
+        return allocations_.load(boost::memory_order_relaxed);
+    }
+
+    uint64_t frees() const
+    {
+        return frees_.load(boost::memory_order_relaxed);
+    }
+
+    void flushAll()
+    {
+        while (count_ > 0)
+        {
+            flush();
+        }
+    }
+
+    Depot* depot() const
+    {
+        return depot_.get();
+    }
+
+    /// the allocator is gone and nothing else holds the depot
+    bool orphaned() const
+    {
+        return depot_.unique();
+    }
+
+    void* allocate()
+    {
+        if (count_ == 0 && !refill())
+        {
+            return NULL;
+        }
+        bump(allocations_);
+        return slots_[--count_];
+    }
+
+    void deallocate(void* p)
+    {
+        if (count_ == kCapacity)
+        {
+            flush();
+        }
+        bump(frees_);
+        slots_[count_++] = p;
+    }
+
+private:
+    static const size_t kCapacity = 2 * kMagazineSize;
+
+    /// single writer, so a plain load and store is enough
+    static void bump(boost::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+    }
+
+    /// reports objects out to the depot on every trip there
+    void publish()
+    {
+        const int64_t out = static_cast<int64_t>(allocations() - frees());
+        depot_->publish(out - published_);
+        published_ = out;
+    }
+
+    bool refill()
+    {
+        publish();
+        Magazine* m = NULL;
+        if (depot_->full.pop(m))
+        {
+            count_ = m->count;
+            ::memcpy(slots_, m->slots, count_ * sizeof(void*));
+            depot_->empty.push(m);
+        }
+        else
+        {
+            count_ = depot_->carve(slots_);
+        }
+        return count_ > 0;
+    }
+
+    /// hands the most recently freed magazine's worth to the depot
+    void flush()
+    {
+        publish();
+        Magazine* m = depot_->takeEmpty();
+        m->count = std::min(count_, kMagazineSize);
+        count_ -= m->count;
+        ::memcpy(m->slots, slots_ + count_, m->count * sizeof(void*));
+        depot_->full.push(m);
+    }
+
+private:
+    boost::shared_ptr<Depot> depot_;
+    size_t count_;
+    void* slots_[kCapacity];
+
+    boost::atomic<uint64_t> allocations_;
+    boost::atomic<uint64_t> frees_;
+    /// allocations_ - frees_ as last reported to the depot
+    int64_t published_;
+};
+
+/// Every cache of one thread, indexed by Depot::index, so finding one is
+/// a bounds check and a load. A slot can only hold a cache of the depot
+/// that currently has its index: the index is not handed out again until
+/// that depot, and so every cache of it, is gone.
+class SlotAllocator::ThreadCaches : boost::noncopyable
+{
+public:
+    /// self is the thread-local pointer to this table, cleared when the
+    /// thread exits and the table goes away
+    explicit ThreadCaches(ThreadCaches** self)
+        :   self_(self)
+    {
+    }
+
+    ~ThreadCaches()
+    {
+        *self_ = NULL;
+        for (size_t i = 0; i < caches_.size(); ++i)
+        {
+            delete caches_[i];
+        }
+    }
+
+    ThreadCache* find(const Depot* depot) const
+    {
+        return depot->index < caches_.size() ? caches_[depot->index] : NULL;
+    }
+
+    /// the first use of an allocator on this thread; also drops the caches
+    /// of allocators destroyed since, so their depots and indexes go too
+    ThreadCache& insert(const boost::shared_ptr<Depot>& depot)
+    {
+        for (size_t i = 0; i < caches_.size(); ++i)
+        {
+            if (caches_[i] != NULL && caches_[i]->orphaned())
+            {
+                delete caches_[i];
+                caches_[i] = NULL;
+            }
+        }
+        if (depot->index >= caches_.size())
+        {
+            caches_.resize(depot->index + 1, NULL);
+        }
+        caches_[depot->index] = new ThreadCache(depot);
+        return *caches_[depot->index];
+    }
+
+    /// hands the slots of depot's cache back and drops it
+    void erase(const Depot* depot)
+    {
+        if (depot->index < caches_.size())
+        {
+            delete caches_[depot->index];
+            caches_[depot->index] = NULL;
+        }
+    }
+
+private:
+    ThreadCaches** self_;
+    std::vector<ThreadCache*> caches_;
+};
+
+PoolStats SlotAllocator::Depot::stats()
+{
+    PoolStats s;
+    s.slotSize = slotSize;
+    {
+        Lock lock(*this);
+        s.allocations = retiredAllocations;
+        s.frees = retiredFrees;
+        for (size_t i = 0; i < caches.size(); ++i)
+        {
+            s.allocations += caches[i]->allocations();
+            s.frees += caches[i]->frees();
+        }
+        s.slabs = slabs.size();
+        s.reservedBytes = slabs.size() * slabBytes;
+        s.lockContentions = lockContentions;
+        s.lockWaitNanos = lockWaitNanos;
+    }
+    // frees counted ahead of the allocations they match can make the
+    // difference briefly negative
+    s.live = s.allocations > s.frees ? s.allocations - s.frees : 0;
+    s.peak = std::max(s.live, own.peak());
+    s.takenAtNanos = PoolStats::nowNanos();
+    return s;
+}
+
+SlotAllocator::SlotAllocator(size_t slotSize, int node, const boost::shared_ptr<LiveCount>& pool)
+    :   depot_(new Depot(slotSize, node, pool))
+{
+}
+
+SlotAllocator::~SlotAllocator()
+{
+    // the destroying thread's cache goes now rather than at its exit, so
+    // a pool on a long-lived thread gives its depot back; other threads
+    // drop theirs on their next first use of an allocator, or at exit
+    if (ThreadCaches* caches = threadCaches())
+    {
+        caches->erase(depot_.get());
+    }
+}
+
+size_t SlotAllocator::slotSize() const
+{
+    return depot_->slotSize;
+}
+
+int SlotAllocator::node() const
+{
+    return depot_->node;
+}
+
+SlotAllocator::ThreadCaches*& SlotAllocator::threadCaches()
+{
+    // read on every allocate() and deallocate(), so a plain thread-local
+    // pointer
+    static BASELIB_THREAD_LOCAL ThreadCaches* caches = NULL;
+    return caches;
+}
+
+SlotAllocator::ThreadCache& SlotAllocator::threadCache()
+{
+    // the TSS slot is only there to delete the table when the thread
+    // exits. Neither is ever destroyed: slots may be freed after every
+    // other static object is gone.
+    static boost::thread_specific_ptr<ThreadCaches>* owner =
+        new boost::thread_specific_ptr<ThreadCaches>();
+    ThreadCaches*& caches = threadCaches();
+    if (caches != NULL)
+    {
+        ThreadCache* cache = caches->find(depot_.get());
+        if (cache != NULL)
+        {
+            return *cache;
+        }
+    }
+    else
+    {
+        caches = new ThreadCaches(&caches);
+        owner->reset(caches);
+    }
+    return caches->insert(depot_);
+}
+
+void* SlotAllocator::allocate()
+{
+    void* p = threadCache().allocate();
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    if (depot_->node >= 0)
+    {
+        Numa::recordAllocation(depot_->node);
+    }
+    return p;
+}
+
+void SlotAllocator::deallocate(void* p)
+{
+    assert(p != NULL);
+#ifdef BASELIB_OBJPOOL_CHECK_OWNERSHIP
+    assert(owns(p));
+#endif
+    if (depot_->node >= 0)
+    {
+        Numa::recordFree(depot_->node);
+    }
+    threadCache().deallocate(p);
+}
+
+PoolStats SlotAllocator::stats() const
+{
+    return depot_->stats();
+}
+
+bool SlotAllocator::owns(const void* p) const
+{
+    return depot_->owns(p);
+}
+
+void SlotAllocator::reserve(size_t n)
+{
+    depot_->reserve(n);
+}
+
+void SlotAllocator::trim()
+{
+    threadCache().flushAll();
+    depot_->trim();
+}
+
+}
@@ -0,0 +1,119 @@
+#ifndef _SLOTALLOCATOR_H
+#define _SLOTALLOCATOR_H
+
+#include <stddef.h>
+#include "stdint.h"
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+
+/// Fixed-size raw slots with per-thread magazines in front of a shared,
+/// lock-free depot; the memory behind CObjPool.
+///
+/// Each thread allocates from and frees into its own array of up to two
+/// magazines' worth of slots, without any synchronization. Only when that
+/// array runs empty or full does the thread go to the depot, and then a
+/// whole magazine of kMagazineSize slots moves in one push or pop on a
+/// lock-free stack. The depot takes its mutex only to carve new slots
+/// when no thread has any to spare.
+///
+/// Slots are bumped off 64 KB slabs mapped straight from the OS, so both
+/// ends are O(1) no matter how many slots are free: allocate()
+/// pops a pointer and deallocate() pushes one, with no ordered free list
+/// to walk. deallocate() trusts the caller; building with
+/// BASELIB_OBJPOOL_CHECK_OWNERSHIP defined makes it assert that the
+/// pointer is a slot of this allocator, at the price of a lock and a scan
+/// of every slab per free.
+///
+/// An allocator can be bound to a NUMA node: its slabs are then placed on
+/// that node and every slot it hands out or takes back is counted in
+/// Numa::stats(). Keeping the slots of each node apart is up to the
+/// caller, which is what CObjPool does with one allocator per node.
+/// Allocators that make up one pool can share a LiveCount, whose peak is
+/// then the high-water mark of the pool as a whole: the allocators' own
+/// peaks fall at different times and do not add up to it.
+///
+/// Each thread keeps the caches of every allocator it has used in one
+/// table reached through a compiler thread-local pointer, so finding the
+/// cache is a bounds check and a load rather than a Boost TSS map
+/// lookup. The depot is shared with every thread cache, so a thread that
+/// exits after the allocator is gone still returns its slots somewhere
+/// valid.
+
+namespace BaseLib
+{
+
+struct PoolStats;
+
+class SlotAllocator : boost::noncopyable
+{
+public:
+    static const size_t kMagazineSize = 32;
+    static const size_t kSlabBytes = 64*1024;
+
+    /// Objects out of every allocator sharing it, as last reported by
+    /// their thread caches, and the most there have been at once.
+    class LiveCount : boost::noncopyable
+    {
+    public:
+        LiveCount();
+
+        void add(int64_t delta);
+
+        uint64_t live() const;
+        uint64_t peak() const;
+
+    private:
+        boost::atomic<int64_t> live_;
+        boost::atomic<int64_t> peak_;
+    };
+
+    /// node -1 leaves placement to the OS and counts nothing; slots going
+    /// out and coming back are also reported to pool, if there is one
+    explicit SlotAllocator(size_t slotSize, int node = -1,
+                           const boost::shared_ptr<LiveCount>& pool = boost::shared_ptr<LiveCount>());
+    ~SlotAllocator();
+
+    size_t slotSize() const;
+
+    int node() const;
+
+    void* allocate();
+
+    /// p must come from allocate() on this allocator, from any thread
+    void deallocate(void* p);
+
+    /// Carves slabs up front until n slots exist in total, with their
+    /// pages already faulted in, so the first n allocations never wait on
+    /// the OS.
+    void reserve(size_t n);
+
+    /// Returns the calling thread's cached slots to the depot, then gives
+    /// every slab whose slots are all free back to the OS. Slots still
+    /// cached by other threads keep their slabs alive.
+    void trim();
+
+    /// Counts summed over every thread cache, under the depot lock. Each
+    /// thread only bumps its own counters on allocate() and deallocate().
+    PoolStats stats() const;
+
+    /// whether p is a slot handed out by this allocator; takes the depot
+    /// lock and scans the slabs, so it is meant for debugging
+    bool owns(const void* p) const;
+
+private:
+    struct Depot;
+    class ThreadCache;
+    class ThreadCaches;
+
+    ThreadCache& threadCache();
+
+    /// the calling thread's table; NULL until it first uses an allocator
+    static ThreadCaches*& threadCaches();
+
+private:
+    boost::shared_ptr<Depot> depot_;
+};
+
+}
+#endif  // _SLOTALLOCATOR_H
@@ -0,0 +1,104 @@
+#include "SpscCircularBuffer.h"
+#include <assert.h>
+#include <algorithm>
+
+namespace BaseLib
+{
+
+const size_t SpscCircularBuffer::kCacheLineSize;
+
+namespace
+{
+
+size_t roundUpPowerOfTwo(size_t n)
+{
+    size_t size = 1;
+    while (size < n)
+    {
+        size <<= 1;
+    }
+    return size;
+}
+
+}
+
+SpscCircularBuffer::SpscCircularBuffer(size_t capacity)
+    :   data_(NULL),
+        capacity_(roundUpPowerOfTwo(capacity)),
+        mask_(capacity_ - 1),
+        head_(0),
+        cachedTail_(0),
+        tail_(0),
+        cachedHead_(0)
+{
+    data_ = new char[capacity_];
+}
+
+SpscCircularBuffer::~SpscCircularBuffer()
+{
+    delete[] data_;
+}
+
+char* SpscCircularBuffer::reserve(size_t& len)
+{
+    const size_t tail = tail_.load(boost::memory_order_relaxed);
+    size_t room = capacity_ - (tail - cachedHead_);
+    if (room < len)
+    {
+        // only go to the shared line when the cached view is not enough
+        cachedHead_ = head_.load(boost::memory_order_acquire);
+        room = capacity_ - (tail - cachedHead_);
+    }
+    const size_t offset = tail & mask_;
+    len = std::min(len, std::min(room, capacity_ - offset));
+    return data_ + offset;
+}
+
+bool SpscCircularBuffer::append(const char* data, size_t len)
+{
+    const size_t tail = tail_.load(boost::memory_order_relaxed);
+    if (capacity_ - (tail - cachedHead_) < len)
+    {
+        cachedHead_ = head_.load(boost::memory_order_acquire);
+        if (capacity_ - (tail - cachedHead_) < len)
+        {
+            return false;
+        }
+    }
+    const size_t offset = tail & mask_;
+    const size_t first = std::min(len, capacity_ - offset);
+    ::memcpy(data_ + offset, data, first);
+    ::memcpy(data_, data + first, len - first);
+    tail_.store(tail + len, boost::memory_order_release);
+    return true;
+}
+
+const char* SpscCircularBuffer::peek(size_t& len)
+{
+    const size_t head = head_.load(boost::memory_order_relaxed);
+    if (cachedTail_ == head)
+    {
+        cachedTail_ = tail_.load(boost::memory_order_acquire);
+    }
+    const size_t offset = head & mask_;
+    len = std::min(cachedTail_ - head, capacity_ - offset);
+    return data_ + offset;
+}
+
+size_t SpscCircularBuffer::read(char* dst, size_t len)
+{
+    const size_t head = head_.load(boost::memory_order_relaxed);
+    if (cachedTail_ - head < len)
+    {
+        cachedTail_ = tail_.load(boost::memory_order_acquire);
+    }
+    len = std::min(len, cachedTail_ - head);
+    const size_t offset = head & mask_;
+    const size_t first = std::min(len, capacity_ - offset);
+    ::memcpy(dst, data_ + offset, first);
+    ::memcpy(dst + first, data_, len - first);
+    head_.store(head + len, boost::memory_order_release);
+    return len;
+}
+
+}
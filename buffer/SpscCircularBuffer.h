@@ -0,0 +1,115 @@
+#ifndef _SPSCCIRCULARBUFFER_H
+#define _SPSCCIRCULARBUFFER_H
+
+#include <string.h>
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+
+/// A byte ring for exactly one producer thread and one consumer thread,
+/// with no locks.
+///
+/// The producer owns tail_ and the consumer owns head_. Both only ever
+/// grow, and the index into the block is taken modulo the power-of-two
+/// capacity. Each side publishes its index with a release store and reads
+/// the other's with an acquire load, so bytes written before commit() are
+/// visible to the consumer that sees the new tail. The two indices, and
+/// each side's cached copy of the other's index, live on separate cache
+/// lines so the threads do not bounce a line between them.
+///
+/// Unlike CircularBuffer a full ring is never overwritten: the producer
+/// can only reuse space the consumer has consumed.
+///
+/// @code
+/// // producer                          // consumer
+/// size_t len = n;                      size_t len;
+/// char* p = ring.reserve(len);         const char* p = ring.peek(len);
+/// fill(p, len);                        parse(p, len);
+/// ring.commit(len);                    ring.consume(len);
+/// @endcode
+
+namespace BaseLib
+{
+
+class SpscCircularBuffer : boost::noncopyable
+{
+public:
+    static const size_t kCacheLineSize = 64;
+
+    /// capacity is rounded up to a power of two
+    explicit SpscCircularBuffer(size_t capacity);
+    ~SpscCircularBuffer();
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    ///
+    /// producer side
+    ///
+
+    /// free bytes as seen by the producer
+    size_t writableBytes() const
+    {
+        return capacity_ - (tail_.load(boost::memory_order_relaxed)
+                            - head_.load(boost::memory_order_acquire));
+    }
+
+    /// Up to len contiguous free bytes; len is set to how many there are,
+    /// which is 0 when the ring is full and may be less than asked for at
+    /// the wrap point. Nothing is visible to the consumer before commit().
+    char* reserve(size_t& len);
+
+    /// publishes len bytes written through reserve()
+    void commit(size_t len)
+    {
+        tail_.store(tail_.load(boost::memory_order_relaxed) + len, boost::memory_order_release);
+    }
+
+    /// all of data or nothing; at most two memcpys
+    bool append(const char* data, size_t len);
+
+    ///
+    /// consumer side
+    ///
+
+    /// bytes committed and not yet consumed, as seen by the consumer
+    size_t readableBytes() const
+    {
+        return tail_.load(boost::memory_order_acquire)
+               - head_.load(boost::memory_order_relaxed);
+    }
+
+    /// The oldest committed bytes, contiguous up to the wrap point; len is
+    /// set to how many there are (0 when empty).
+    const char* peek(size_t& len);
+
+    /// gives len peeked bytes back to the producer
+    void consume(size_t len)
+    {
+        head_.store(head_.load(boost::memory_order_relaxed) + len, boost::memory_order_release);
+    }
+
+    /// copies and consumes up to len bytes; at most two memcpys
+    size_t read(char* dst, size_t len);
+
+private:
+    char* data_;
+    size_t capacity_;
+    size_t mask_;
+
+    char pad0_[kCacheLineSize];
+    /// consumer index, and the consumer's last view of tail_
+    boost::atomic<size_t> head_;
+    size_t cachedTail_;
+
+    char pad1_[kCacheLineSize];
+    /// producer index, and the producer's last view of head_
+    boost::atomic<size_t> tail_;
+    size_t cachedHead_;
+
+    char pad2_[kCacheLineSize];
+};
+
+}
+#endif  // _SPSCCIRCULARBUFFER_H
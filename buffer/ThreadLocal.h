@@ -0,0 +1,15 @@
+#ifndef _THREADLOCAL_H
+#define _THREADLOCAL_H
+
+/// Storage class of a plain thread-local variable: POD types only, no
+/// constructor or destructor, and reaching it is a single load rather
+/// than a boost::thread_specific_ptr map lookup. Where something has to
+/// be cleaned up when the thread exits, pair it with a
+/// thread_specific_ptr that is only used for that.
+#ifdef _MSC_VER
+#define BASELIB_THREAD_LOCAL __declspec(thread)
+#else
+#define BASELIB_THREAD_LOCAL __thread
+#endif
+
+#endif  // _THREADLOCAL_H
@@ -0,0 +1,177 @@
+#include "Varint.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BASELIB_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace BaseLib
+{
+
+namespace
+{
+
+#ifdef BASELIB_HAVE_SSE2
+inline unsigned countTrailingZeros(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+template <typename T>
+size_t encodeVarint(T x, char* out)
+{
+    size_t n = 0;
+    while (x >= 0x80)
+    {
+        out[n++] = static_cast<char>(x | 0x80);
+        x >>= 7;
+    }
+    out[n++] = static_cast<char>(x);
+    return n;
+}
+
+template <typename T>
+size_t decodeVarint(const char* begin, const char* end, T* x, size_t maxBytes)
+{
+    T result = 0;
+    const char* p = begin;
+    for (size_t shift = 0; p < end && p - begin < static_cast<ptrdiff_t>(maxBytes); shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        result |= static_cast<T>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *x = result;
+            return p - begin;
+        }
+    }
+    return 0;
+}
+
+}
+
+size_t encodeVarint32(uint32_t x, char* out)
+{
+    return encodeVarint(x, out);
+}
+
+size_t encodeVarint64(uint64_t x, char* out)
+{
+    return encodeVarint(x, out);
+}
+
+size_t decodeVarint32(const char* begin, const char* end, uint32_t* x)
+{
+    return decodeVarint(begin, end, x, kMaxVarint32Bytes);
+}
+
+size_t decodeVarint64(const char* begin, const char* end, uint64_t* x)
+{
+    return decodeVarint(begin, end, x, kMaxVarint64Bytes);
+}
+
+size_t encodeVarint32Array(const uint32_t* values, size_t count, char* out)
+{
+    char* p = out;
+    size_t i = 0;
+#ifdef BASELIB_HAVE_SSE2
+    const __m128i highBits = _mm_set1_epi32(~0x7F);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i* in = reinterpret_cast<const __m128i*>(values + i);
+        __m128i a = _mm_loadu_si128(in);
+        __m128i b = _mm_loadu_si128(in + 1);
+        __m128i c = _mm_loadu_si128(in + 2);
+        __m128i d = _mm_loadu_si128(in + 3);
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, highBits), zero)) == 0xFFFF)
+        {
+            // all sixteen fit in one byte each: narrow 32 -> 16 -> 8 bits
+            __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), bytes);
+            p += 16;
+        }
+        else
+        {
+            for (size_t j = 0; j < 16; ++j)
+            {
+                p += encodeVarint(values[i + j], p);
+            }
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        p += encodeVarint(values[i], p);
+    }
+    return p - out;
+}
+
+size_t decodeVarint32Array(const char* begin, const char* end,
+                           uint32_t* values, size_t count, size_t* consumed)
+{
+    const char* p = begin;
+    size_t n = 0;
+#ifdef BASELIB_HAVE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    while (count - n >= 16 && end - p >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+        if (mask == 0)
+        {
+            // sixteen single-byte varints: widen 8 -> 16 -> 32 bits
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            __m128i* out = reinterpret_cast<__m128i*>(values + n);
+            _mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+            p += 16;
+            n += 16;
+            continue;
+        }
+        // the single-byte run in front of the first multi-byte varint
+        unsigned run = countTrailingZeros(mask);
+        for (unsigned i = 0; i < run; ++i)
+        {
+            values[n++] = static_cast<uint8_t>(p[i]);
+        }
+        p += run;
+        size_t used = decodeVarint(p, end, &values[n], kMaxVarint32Bytes);
+        if (used == 0)
+        {
+            *consumed = p - begin;
+            return n;
+        }
+        p += used;
+        ++n;
+    }
+#endif
+    for (; n < count; ++n)
+    {
+        size_t used = decodeVarint(p, end, &values[n], kMaxVarint32Bytes);
+        if (used == 0)
+        {
+            break;
+        }
+        p += used;
+    }
+    *consumed = p - begin;
+    return n;
+}
+
+}
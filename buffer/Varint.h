@@ -0,0 +1,62 @@
+#ifndef _VARINT_H
+#define _VARINT_H
+
+#include <stddef.h>
+#include "stdint.h"
+
+/// LEB128 varint and zigzag codecs on raw memory, as used by Buffer.
+///
+/// The decoders return the number of bytes consumed, or 0 when
+/// [begin, end) does not start with a complete varint. Once at least
+/// kMaxVarint32Bytes / kMaxVarint64Bytes are available a 0 means the
+/// input is malformed rather than short.
+
+namespace BaseLib
+{
+
+static const size_t kMaxVarint32Bytes = 5;
+static const size_t kMaxVarint64Bytes = 10;
+
+inline uint32_t zigZagEncode32(int32_t x)
+{
+    return (static_cast<uint32_t>(x) << 1) ^ static_cast<uint32_t>(x >> 31);
+}
+
+inline int32_t zigZagDecode32(uint32_t x)
+{
+    return static_cast<int32_t>((x >> 1) ^ (0u - (x & 1)));
+}
+
+inline uint64_t zigZagEncode64(int64_t x)
+{
+    return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+}
+
+inline int64_t zigZagDecode64(uint64_t x)
+{
+    return static_cast<int64_t>((x >> 1) ^ (0ull - (x & 1)));
+}
+
+/// out needs room for kMaxVarint32Bytes; returns the bytes written
+size_t encodeVarint32(uint32_t x, char* out);
+
+size_t encodeVarint64(uint64_t x, char* out);
+
+size_t decodeVarint32(const char* begin, const char* end, uint32_t* x);
+
+size_t decodeVarint64(const char* begin, const char* end, uint64_t* x);
+
+/// Bulk versions: runs of values below 128 are packed / unpacked 16 at
+/// a time with SSE2.
+
+/// out needs room for count * kMaxVarint32Bytes; returns the bytes written
+size_t encodeVarint32Array(const uint32_t* values, size_t count, char* out);
+
+/// decodes at most count values, stopping early at an incomplete or
+/// malformed varint; returns how many were decoded and stores the bytes
+/// they took in *consumed
+size_t decodeVarint32Array(const char* begin, const char* end,
+                           uint32_t* values, size_t count, size_t* consumed);
+
+}
+#endif  // _VARINT_H
@@ -27,6 +27,12 @@ namespace AsioModel{
 
 		void setpoolsize(std::size_t pool_size);
 
+		/// Pin io_service thread i to NUMA node i % node count, so that the
+		/// pools its handlers allocate from stay on one node. Off by default:
+		/// pinning takes the threads away from the scheduler, which only pays
+		/// when the process owns the machine. Takes effect on the next run().
+		void setnumabinding(bool bind);
+
 		/// Get an io_service to use.
 		boost::asio::io_service& get_io_service();
 
@@ -48,6 +54,8 @@ namespace AsioModel{
 		std::size_t pool_size_;
 
 		bool running_;
+
+		bool bind_numa_;
 	};
 
 
@@ -24,6 +24,11 @@ using namespace boost::gregorian;
 
 namespace AsioModel{
 
+	/// <summary>
+	/// Smallest writable tail an async read is started with.
+	/// </summary>
+	static const std::size_t kMinReadSize = 2048;
+
 	/// <summary>
 	/// Initializes a new tcp connection of the <see cref="TcpConnection"/> class.
 	/// </summary>
@@ -53,7 +58,16 @@ namespace AsioModel{
 	/// </summary>
 	void TcpConnection::Start()
 	{
-		socket_.async_read_some(boost::asio::buffer(readBuffer_),
+		asyncRead();
+	}
+
+	/// <summary>
+	/// Reads straight into the writable tail of the receive buffer.
+	/// </summary>
+	void TcpConnection::asyncRead()
+	{
+		receiveMsgbuffer_.ensureWritableBytes(kMinReadSize);
+		socket_.async_read_some(boost::asio::buffer(receiveMsgbuffer_.beginWrite(), receiveMsgbuffer_.writableBytes()),
 			boost::bind(&TcpConnection::handle_read, shared_from_this(),
 			boost::asio::placeholders::error,
 			boost::asio::placeholders::bytes_transferred));
@@ -71,7 +85,19 @@ namespace AsioModel{
 		{
 			if(bytes_transferred > 0)
 			{
-				receiveMsgbuffer_.append(readBuffer_.data(),bytes_transferred);
+				receiveMsgbuffer_.hasWritten(bytes_transferred);
+#ifndef WIN32
+				if (receiveMsgbuffer_.writableBytes() == 0)
+				{
+					// the tail filled up, so the socket probably holds more:
+					// take it now with one readv instead of another round trip
+					// through the reactor. readFd never blocks, so the socket
+					// stays in whatever mode its owner left it; EOF and errors
+					// are left for the next async read to report.
+					int savedErrno = 0;
+					receiveMsgbuffer_.readFd(socket_.native_handle(), &savedErrno);
+				}
+#endif
 				boost::posix_time::ptime  receiveTime = boost::posix_time::microsec_clock::universal_time();
 				bool receAgain = true;
 
@@ -82,10 +108,7 @@ namespace AsioModel{
 
 				if ( receAgain && socket_.is_open())
 				{
-					socket_.async_read_some(boost::asio::buffer(readBuffer_),
-						boost::bind(&TcpConnection::handle_read, shared_from_this(),
-						boost::asio::placeholders::error,
-						boost::asio::placeholders::bytes_transferred));
+					asyncRead();
 				}
 
 				boost::weak_ptr<WheelEntry<TcpConnection> > weak_ptr(boost::any_cast<boost::weak_ptr<WheelEntry<TcpConnection> > >(any_));
@@ -111,8 +134,7 @@ namespace AsioModel{
 	/// Handle writes the data with error code.
 	/// </summary>
 	/// <param name="e">The error code.</param>
-	/// <param name="pSendMsg">The point of MSG sent.</param>
-	void TcpConnection::handle_write(const boost::system::error_code& e, std::string* pSendMsg)
+	void TcpConnection::handle_write(const boost::system::error_code& e)
 	{
 		if (!e)
 		{
@@ -142,17 +164,9 @@ namespace AsioModel{
 
 		if ( !bSendListEmpty )
 		{
-			std::string* pNextSendMsg = sendList_.front();
-			boost::asio::async_write(socket_,
-				boost::asio::buffer(pNextSendMsg->c_str(),pNextSendMsg->length()),
+			boost::asio::async_write(socket_, sendList_.front(),
 				boost::bind(&TcpConnection::handle_write, shared_from_this(),
-				boost::asio::placeholders::error,pNextSendMsg));
-		}
-
-		if (pSendMsg)
-		{
-			delete pSendMsg;
-			pSendMsg = NULL;
+				boost::asio::placeholders::error));
 		}
 	}
 
@@ -164,8 +178,7 @@ namespace AsioModel{
 	/// <param name="callback">ηǷҪ÷ɵĻص.</param>
 	void TcpConnection::Send( char* buf, uint32_t nLength,bool callback)
 	{
-		string msg(buf,nLength);
-		Send( msg ,callback);
+		Send(BaseLib::BufferSlice::copyOf(buf, nLength), callback);
 	}
 
 	/// <summary>
@@ -175,22 +188,28 @@ namespace AsioModel{
 	/// <param name="callback">ηǷҪ÷ɵĻص.</param>
 	void TcpConnection::Send( std::string& message, bool callback)
 	{
-		std::string* pSendMsg = new std::string;
-		pSendMsg->swap(message);
-		//pSendMsg->append("\r\n\r\n");
+		Send(BaseLib::BufferSlice::fromString(message), callback);
+	}
+
+	/// <summary>
+	/// Sends the specified slice without copying its bytes.
+	/// </summary>
+	/// <param name="slice">The slice to send, e.g. from Buffer::readAsSlice.</param>
+	/// <param name="callback">Whether WriteCompleteCallBack is called once it is sent.</param>
+	void TcpConnection::Send( const BaseLib::BufferSlice& slice, bool callback)
+	{
 		boost::lock_guard<boost::mutex> lock(sendMutex_);
 		if (sendList_.empty())
 		{
-			sendList_.push_back(pSendMsg);
+			sendList_.push_back(slice);
 			sendCompleteCallBackList_.push_back(callback);
-			boost::asio::async_write(socket_,
-				boost::asio::buffer(pSendMsg->c_str(),pSendMsg->length()),
+			boost::asio::async_write(socket_, sendList_.front(),
 				boost::bind(&TcpConnection::handle_write, shared_from_this(),
-				boost::asio::placeholders::error,pSendMsg));
+				boost::asio::placeholders::error));
 		}
 		else
 		{
-			sendList_.push_back(pSendMsg);
+			sendList_.push_back(slice);
 			sendCompleteCallBackList_.push_back(callback);
 		}
 	}
@@ -202,8 +221,7 @@ namespace AsioModel{
 	/// <param name="callback">ηǷҪ÷ɵĻص.</param>
 	void TcpConnection::Send( const char* buf, bool callback /*= false*/ )
 	{
-		string msg(buf);
-		Send( msg ,callback);
+		Send(BaseLib::BufferSlice::copyOf(buf, strlen(buf)), callback);
 	}
 
 	/// <summary>
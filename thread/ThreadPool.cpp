@@ -3,19 +3,31 @@
 #include <assert.h>
 #include <stdio.h>
 #include <boost/thread/locks.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
 
 using namespace BaseLib;
 
 namespace BaseLib
 {
+	namespace
+	{
+		/// most tasks a worker moves from the injection queue at once
+		const size_t kMaxInjectBatch = 32;
+	}
+
 	/// <summary>
 	/// Initializes a new instance of the <see cref="ThreadPool"/> class.
 	/// </summary>
 	/// <param name="name">The name.</param>
-	ThreadPool::ThreadPool(const string& name)
+	/// <param name="mode">Shared queue or work stealing.</param>
+	ThreadPool::ThreadPool(const string& name, Mode mode)
 		: mutex_()
 		, name_(name)
 		, running_(false)
+		, mode_(mode)
+		, injected_(0)
+		, sleepers_(0)
 	{
 	}
 
@@ -39,6 +51,15 @@ namespace BaseLib
 		assert(threads_.empty());
 		running_ = true;
 		threads_.reserve(numThreads);
+		if (mode_ == kWorkStealing)
+		{
+			// every deque exists before any worker goes looking for a victim
+			workers_.reserve(numThreads);
+			for (int i = 0; i < numThreads; ++i)
+			{
+				workers_.push_back(new Worker(this, i));
+			}
+		}
 		for (int i = 0; i < numThreads; ++i)
 		{
 			char id[32];
@@ -48,8 +69,16 @@ namespace BaseLib
 			snprintf(id, sizeof id, "%d", i);
 #endif // WIN32
 
-			threads_.push_back(new Thread(
-				boost::bind(&ThreadPool::runInThread, this), name_+id));
+			Thread::ThreadFunc func;
+			if (mode_ == kWorkStealing)
+			{
+				func = boost::bind(&ThreadPool::runWorker, this, i);
+			}
+			else
+			{
+				func = boost::bind(&ThreadPool::runInThread, this);
+			}
+			threads_.push_back(new Thread(func, name_+id));
 			threads_[i].start();
 		}
 	}
@@ -67,6 +96,15 @@ namespace BaseLib
 		for_each(threads_.begin(),
 			threads_.end(),
 			boost::bind(&Thread::join, _1));
+
+		// like the shared queue, whatever was still queued is dropped
+		for (size_t i = 0; i < workers_.size(); ++i)
+		{
+			while (Task* task = workers_[i].deque.pop())
+			{
+				delete task;
+			}
+		}
 	}
 
 	/// <summary>
@@ -79,6 +117,31 @@ namespace BaseLib
 		{
 			task();
 		}
+		else if (mode_ == kWorkStealing)
+		{
+			Worker* self = currentWorker().get();
+			if (self != NULL && self->pool == this)
+			{
+				self->deque.push(new Task(task));
+				// pairs with park(): either a parking worker sees the task
+				// or we see it counted and wake it
+				if (sleepers_.load(boost::memory_order_seq_cst) > 0)
+				{
+					boost::lock_guard<boost::mutex> lock(mutex_);
+					cond_.notify_one();
+				}
+			}
+			else
+			{
+				boost::lock_guard<boost::mutex> lock(mutex_);
+				queue_.push_back(task);
+				injected_.store(queue_.size(), boost::memory_order_relaxed);
+				if (sleepers_.load(boost::memory_order_relaxed) > 0)
+				{
+					cond_.notify_one();
+				}
+			}
+		}
 		else
 		{
 			boost::lock_guard<boost::mutex> lock(mutex_);
@@ -134,4 +197,155 @@ namespace BaseLib
 		}
 	}
 
+	/// <summary>
+	/// Work-stealing worker loop: own deque first, then the injection
+	/// queue, then the other workers' deques, and sleep when all are empty.
+	/// </summary>
+	/// <param name="index">The worker's index.</param>
+	void ThreadPool::runWorker(size_t index)
+	{
+		Worker& self = workers_[index];
+		currentWorker().reset(&self);
+		try
+		{
+			while (running_)
+			{
+				Task* task = self.deque.pop();
+				if (task == NULL)
+				{
+					task = takeInjected(self);
+				}
+				if (task == NULL)
+				{
+					task = steal(self);
+				}
+				if (task == NULL)
+				{
+					park();
+					continue;
+				}
+				boost::scoped_ptr<Task> owner(task);
+				(*task)();
+			}
+		}
+		catch (const std::exception& ex)
+		{
+			fprintf(stderr, "exception caught in ThreadPool %s\n", name_.c_str());
+			fprintf(stderr, "reason: %s\n", ex.what());
+			abort();
+		}
+		catch (...)
+		{
+			fprintf(stderr, "unknown exception caught in ThreadPool %s\n", name_.c_str());
+			throw; // rethrow
+		}
+		currentWorker().reset();
+	}
+
+	/// <summary>
+	/// Takes a share of the injection queue: the first task to run now,
+	/// the rest onto the worker's own deque, where others can steal them.
+	/// </summary>
+	/// <param name="self">The calling worker.</param>
+	/// <returns>A task to run, or NULL.</returns>
+	ThreadPool::Task* ThreadPool::takeInjected(Worker& self)
+	{
+		if (injected_.load(boost::memory_order_relaxed) == 0)
+		{
+			return NULL;
+		}
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		if (queue_.empty())
+		{
+			return NULL;
+		}
+		const size_t n = std::min(std::min(queue_.size() / workers_.size() + 1, queue_.size()), kMaxInjectBatch);
+		Task* first = new Task;
+		first->swap(queue_.front());
+		queue_.pop_front();
+		for (size_t i = 1; i < n; ++i)
+		{
+			Task* task = new Task;
+			task->swap(queue_.front());
+			queue_.pop_front();
+			self.deque.push(task);
+		}
+		injected_.store(queue_.size(), boost::memory_order_relaxed);
+		if (n > 1 && sleepers_.load(boost::memory_order_relaxed) > 0)
+		{
+			cond_.notify_one();
+		}
+		return first;
+	}
+
+	/// <summary>
+	/// Tries every other worker once, starting at a random one.
+	/// </summary>
+	/// <param name="self">The calling worker.</param>
+	/// <returns>A stolen task, or NULL.</returns>
+	ThreadPool::Task* ThreadPool::steal(Worker& self)
+	{
+		const size_t count = workers_.size();
+		if (count < 2)
+		{
+			return NULL;
+		}
+		self.seed ^= self.seed << 13;
+		self.seed ^= self.seed >> 17;
+		self.seed ^= self.seed << 5;
+		const size_t start = self.seed % count;
+		for (size_t i = 0; i < count; ++i)
+		{
+			Worker& victim = workers_[(start + i) % count];
+			if (&victim == &self)
+			{
+				continue;
+			}
+			if (Task* task = victim.deque.steal())
+			{
+				return task;
+			}
+		}
+		return NULL;
+	}
+
+	/// <summary>
+	/// Sleeps until run() or stop() wakes the worker, unless work has
+	/// shown up in the meantime.
+	/// </summary>
+	void ThreadPool::park()
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		sleepers_.fetch_add(1, boost::memory_order_seq_cst);
+		if (running_ && queue_.empty() && !hasStealableWork())
+		{
+			cond_.wait(lock);
+		}
+		sleepers_.fetch_sub(1, boost::memory_order_relaxed);
+	}
+
+	bool ThreadPool::hasStealableWork() const
+	{
+		for (size_t i = 0; i < workers_.size(); ++i)
+		{
+			if (!workers_[i].deque.empty())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	boost::thread_specific_ptr<ThreadPool::Worker>& ThreadPool::currentWorker()
+	{
+		// never destroyed, and never deletes the worker it points to
+		static boost::thread_specific_ptr<Worker>* current =
+			new boost::thread_specific_ptr<Worker>(&ThreadPool::forgetWorker);
+		return *current;
+	}
+
+	void ThreadPool::forgetWorker(Worker*)
+	{
+	}
+
 }
@@ -2,6 +2,7 @@
 #define BASE_THREADPOOL_H
 
 #include "Thread.h"
+#include "WorkStealingDeque.h"
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
@@ -10,17 +11,32 @@
 #include <string>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/atomic.hpp>
 
 using namespace std;
 
 namespace BaseLib
 {
+/// kSharedQueue runs tasks in submission order from one queue behind one
+/// lock. kWorkStealing gives every worker its own WorkStealingDeque:
+/// run() called from a worker pushes onto that worker's deque without
+/// locking, run() from any other thread goes through the injection queue
+/// (queue_), and a worker whose deque is empty takes a batch from the
+/// injection queue or steals from a random other worker before going to
+/// sleep. Tasks then no longer run in submission order.
 class ThreadPool : boost::noncopyable
 {
 public:
     typedef boost::function<void ()> Task;
 
-    explicit ThreadPool(const string& name = string());
+    enum Mode
+    {
+        kSharedQueue,
+        kWorkStealing
+    };
+
+    explicit ThreadPool(const string& name = string(), Mode mode = kSharedQueue);
     ~ThreadPool();
 
     void start(int numThreads);
@@ -29,15 +45,45 @@ public:
     void run(const Task& f);
 
 private:
+    struct Worker : boost::noncopyable
+    {
+        Worker(ThreadPool* p, size_t i)
+            : pool(p), index(i), seed(static_cast<unsigned>(i) * 2654435761u + 1)
+        {
+        }
+
+        ThreadPool* pool;
+        size_t index;
+        /// xorshift state for picking victims
+        unsigned seed;
+        WorkStealingDeque<Task> deque;
+    };
+
     void runInThread();
     Task take();
 
+    void runWorker(size_t index);
+    Task* takeInjected(Worker& self);
+    Task* steal(Worker& self);
+    void park();
+    bool hasStealableWork() const;
+
+    static boost::thread_specific_ptr<Worker>& currentWorker();
+    static void forgetWorker(Worker*);
+
     boost::mutex mutex_;
     boost::condition_variable  cond_;
     string name_;
     boost::ptr_vector<Thread> threads_;
     std::deque<Task> queue_;
-    bool running_;
+    boost::atomic<bool> running_;
+
+    const Mode mode_;
+    boost::ptr_vector<Worker> workers_;
+    /// queue_.size() as of the last change, for a look without the lock
+    boost::atomic<size_t> injected_;
+    /// workers waiting on cond_ in work-stealing mode
+    boost::atomic<int> sleepers_;
 };
 
 }
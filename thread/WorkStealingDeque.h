@@ -0,0 +1,178 @@
+#ifndef BASE_WORKSTEALINGDEQUE_H
+#define BASE_WORKSTEALINGDEQUE_H
+
+#include <stddef.h>
+#include <vector>
+#include "stdint.h"
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace BaseLib
+{
+
+/// Chase-Lev work-stealing deque of T pointers.
+///
+/// The owning thread pushes and pops at the bottom, like a stack, without
+/// any read-modify-write unless the deque is down to its last element.
+/// Any other thread may steal from the top with one CAS; a steal that
+/// loses a race returns NULL rather than retrying, so a thief can move on
+/// to another victim. The ring grows when full; the arrays it outgrew are
+/// kept until the deque is destroyed, since a thief may still be reading
+/// from one. The deque never owns the pointed-to elements.
+template <class T>
+class WorkStealingDeque : boost::noncopyable
+{
+public:
+    explicit WorkStealingDeque(size_t capacity = 256)
+        :   top_(0),
+            bottom_(0),
+            array_(new Array(roundUp(capacity)))
+    {
+    }
+
+    ~WorkStealingDeque()
+    {
+        delete array_.load(boost::memory_order_relaxed);
+        for (size_t i = 0; i < retired_.size(); ++i)
+        {
+            delete retired_[i];
+        }
+    }
+
+    /// owner only
+    void push(T* x)
+    {
+        const int64_t b = bottom_.load(boost::memory_order_relaxed);
+        const int64_t t = top_.load(boost::memory_order_acquire);
+        Array* a = array_.load(boost::memory_order_relaxed);
+        if (b - t >= static_cast<int64_t>(a->capacity))
+        {
+            a = grow(a, t, b);
+        }
+        a->put(b, x);
+        // seq_cst rather than release: ThreadPool pairs it with its count
+        // of sleeping workers, so that a worker about to sleep either sees
+        // this element or is woken for it
+        bottom_.store(b + 1, boost::memory_order_seq_cst);
+    }
+
+    /// owner only; NULL if empty
+    T* pop()
+    {
+        const int64_t b = bottom_.load(boost::memory_order_relaxed) - 1;
+        Array* a = array_.load(boost::memory_order_relaxed);
+        bottom_.store(b, boost::memory_order_seq_cst);
+        int64_t t = top_.load(boost::memory_order_seq_cst);
+        if (t > b)
+        {
+            bottom_.store(b + 1, boost::memory_order_relaxed);
+            return NULL;
+        }
+        T* x = a->get(b);
+        if (t == b)
+        {
+            // the last element: race the thieves for it
+            if (!top_.compare_exchange_strong(t, t + 1, boost::memory_order_seq_cst,
+                                              boost::memory_order_relaxed))
+            {
+                x = NULL;
+            }
+            bottom_.store(b + 1, boost::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    /// any thread; NULL if empty or another thread got there first
+    T* steal()
+    {
+        int64_t t = top_.load(boost::memory_order_seq_cst);
+        const int64_t b = bottom_.load(boost::memory_order_seq_cst);
+        if (t >= b)
+        {
+            return NULL;
+        }
+        Array* a = array_.load(boost::memory_order_acquire);
+        T* x = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, boost::memory_order_seq_cst,
+                                          boost::memory_order_relaxed))
+        {
+            return NULL;
+        }
+        return x;
+    }
+
+    /// a snapshot; exact only when no other thread is using the deque
+    bool empty() const
+    {
+        const int64_t b = bottom_.load(boost::memory_order_seq_cst);
+        const int64_t t = top_.load(boost::memory_order_seq_cst);
+        return b <= t;
+    }
+
+private:
+    struct Array : boost::noncopyable
+    {
+        explicit Array(size_t n)
+            :   capacity(n),
+                mask(n - 1),
+                items(new boost::atomic<T*>[n])
+        {
+        }
+
+        ~Array()
+        {
+            delete[] items;
+        }
+
+        T* get(int64_t i) const
+        {
+            return items[i & mask].load(boost::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T* x)
+        {
+            items[i & mask].store(x, boost::memory_order_relaxed);
+        }
+
+        const size_t capacity;
+        const size_t mask;
+        boost::atomic<T*>* items;
+    };
+
+    static size_t roundUp(size_t n)
+    {
+        size_t capacity = 2;
+        while (capacity < n)
+        {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    Array* grow(Array* a, int64_t t, int64_t b)
+    {
+        Array* bigger = new Array(a->capacity * 2);
+        for (int64_t i = t; i < b; ++i)
+        {
+            bigger->put(i, a->get(i));
+        }
+        retired_.push_back(a);
+        array_.store(bigger, boost::memory_order_release);
+        return bigger;
+    }
+
+private:
+    /// thieves take at top_, the owner works at bottom_; each on its own
+    /// cache line
+    boost::atomic<int64_t> top_;
+    char pad0_[64 - sizeof(boost::atomic<int64_t>)];
+    boost::atomic<int64_t> bottom_;
+    char pad1_[64 - sizeof(boost::atomic<int64_t>)];
+    boost::atomic<Array*> array_;
+    /// owner only
+    std::vector<Array*> retired_;
+};
+
+}
+
+#endif